@@ -0,0 +1,131 @@
+/**
+ * @file coalesce_bench.c
+ * @brief Immediate vs deferred coalescing
+ *
+ * Runs two workloads, each once coalescing every free right away
+ * (MM_QUICK_MAX 0) and once deferring it for blocks of up to 1 KB:
+ *
+ * - pingpong: a working set of 10K blocks of 272 bytes to 1 KB; a random
+ *   block is freed and a block of the same size allocated again, 4M times
+ * - fragment: a working set of 20K blocks of 32 bytes to 4 KB, replaced by
+ *   blocks of random size 2M times, with half the set freed and refilled
+ *   every 200K operations
+ *
+ * Sizes stay above the slab classes in pingpong so that every request
+ * reaches the heap. One line per run, with the heap's merge and split
+ * counters from mm_stats:
+ *
+ *     workload=pingpong coalescing=deferred secs=0.185 mops=43.15
+ *     peak_heap=6822608 coalesces=6662 splits=9999
+ *
+ * Build:
+ *
+ *     cc -O2 -DDRIVER -I. -Ibench mm.c bench/memlib.c bench/coalesce_bench.c \
+ *        -o coalesce_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+#define PINGPONG_OBJECTS 10000
+#define PINGPONG_OPS 4000000
+#define FRAGMENT_OBJECTS 20000
+#define FRAGMENT_OPS 2000000
+#define FRAGMENT_PHASE 200000
+
+static void *objs[FRAGMENT_OBJECTS];
+static size_t sizes[FRAGMENT_OBJECTS];
+static size_t peak_heap;
+
+/**
+ * @brief mm_malloc that records the peak heap size
+ */
+static void *tracked_malloc(size_t size) {
+    void *ptr = mm_malloc(size);
+    if (ptr == NULL) {
+        fprintf(stderr, "coalesce_bench: out of memory\n");
+        exit(1);
+    }
+    if (mem_heapsize() > peak_heap) {
+        peak_heap = mem_heapsize();
+    }
+    return ptr;
+}
+
+static void pingpong(void) {
+    for (size_t i = 0; i < PINGPONG_OBJECTS; i++) {
+        sizes[i] = 272 + (size_t)rand() % 753;
+        objs[i] = tracked_malloc(sizes[i]);
+    }
+    for (size_t op = 0; op < PINGPONG_OPS; op++) {
+        size_t i = (size_t)rand() % PINGPONG_OBJECTS;
+        mm_free(objs[i]);
+        objs[i] = tracked_malloc(sizes[i]);
+    }
+    for (size_t i = 0; i < PINGPONG_OBJECTS; i++) {
+        mm_free(objs[i]);
+    }
+}
+
+static void fragment(void) {
+    for (size_t i = 0; i < FRAGMENT_OBJECTS; i++) {
+        objs[i] = tracked_malloc(32 + (size_t)rand() % 4065);
+    }
+    for (size_t op = 0; op < FRAGMENT_OPS; op++) {
+        if (op % FRAGMENT_PHASE == 0) {
+            for (size_t i = op / FRAGMENT_PHASE % 2; i < FRAGMENT_OBJECTS;
+                 i += 2) {
+                mm_free(objs[i]);
+                objs[i] = tracked_malloc(32 + (size_t)rand() % 4065);
+            }
+        }
+        size_t i = (size_t)rand() % FRAGMENT_OBJECTS;
+        mm_free(objs[i]);
+        objs[i] = tracked_malloc(32 + (size_t)rand() % 4065);
+    }
+    for (size_t i = 0; i < FRAGMENT_OBJECTS; i++) {
+        mm_free(objs[i]);
+    }
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(const char *name, void (*workload)(void), size_t ops,
+                bool deferred) {
+    mem_reset_brk();
+    mm_mallopt(MM_QUICK_MAX, deferred ? 1024 : 0);
+    if (!mm_init()) {
+        fprintf(stderr, "coalesce_bench: mm_init failed\n");
+        exit(1);
+    }
+
+    srand(1);
+    peak_heap = mem_heapsize();
+    double start = now();
+    workload();
+    double secs = now() - start;
+
+    mm_stats_t stats;
+    mm_stats(&stats);
+    printf("workload=%s coalescing=%s secs=%.3f mops=%.2f peak_heap=%zu "
+           "coalesces=%zu splits=%zu\n",
+           name, deferred ? "deferred" : "immediate", secs,
+           2 * ops / secs / 1e6, peak_heap, stats.coalesces, stats.splits);
+}
+
+int main(void) {
+    mem_init();
+    run("pingpong", pingpong, PINGPONG_OPS, false);
+    run("pingpong", pingpong, PINGPONG_OPS, true);
+    run("fragment", fragment, FRAGMENT_OPS, false);
+    run("fragment", fragment, FRAGMENT_OPS, true);
+    return 0;
+}
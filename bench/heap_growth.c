@@ -0,0 +1,106 @@
+/**
+ * @file heap_growth.c
+ * @brief Heap extensions and peak heap size, fixed vs adaptive chunksize
+ *
+ * Runs two workloads, each once with the heap growing by a fixed 1 KB
+ * (chunksize_min == chunksize_max) and once with the adaptive default:
+ *
+ * - startup: 200K objects allocated and never freed, 90% of them of
+ *   16-512 bytes and the rest of 512 bytes to 8 KB
+ * - steady: a working set of 20K such objects, randomly replaced 2M times
+ *
+ * A heap extension is counted whenever mem_heapsize() grows across a call.
+ * One line per run:
+ *
+ *     workload=startup chunksize=adaptive extensions=183 peak_heap=137969664
+ *
+ * Build:
+ *
+ *     cc -O2 -DDRIVER -I. -Ibench mm.c bench/memlib.c bench/heap_growth.c \
+ *        -o heap_growth
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+#define STARTUP_OBJECTS 200000
+#define STEADY_OBJECTS 20000
+#define STEADY_OPS 2000000
+
+static void *objs[STARTUP_OBJECTS];
+static size_t extensions;
+static size_t peak_heap;
+
+static size_t pick_size(void) {
+    if (rand() % 10 != 0) {
+        return 16 + (size_t)rand() % 497;
+    }
+    return 512 + (size_t)rand() % 7681;
+}
+
+/**
+ * @brief mm_malloc that records heap growth
+ */
+static void *tracked_malloc(size_t size) {
+    size_t before = mem_heapsize();
+    void *ptr = mm_malloc(size);
+    if (ptr == NULL) {
+        fprintf(stderr, "heap_growth: out of memory\n");
+        exit(1);
+    }
+    size_t after = mem_heapsize();
+    if (after > before) {
+        extensions++;
+    }
+    if (after > peak_heap) {
+        peak_heap = after;
+    }
+    return ptr;
+}
+
+static void startup(void) {
+    for (size_t i = 0; i < STARTUP_OBJECTS; i++) {
+        objs[i] = tracked_malloc(pick_size());
+    }
+}
+
+static void steady(void) {
+    for (size_t i = 0; i < STEADY_OBJECTS; i++) {
+        objs[i] = tracked_malloc(pick_size());
+    }
+    for (size_t op = 0; op < STEADY_OPS; op++) {
+        size_t i = (size_t)rand() % STEADY_OBJECTS;
+        mm_free(objs[i]);
+        objs[i] = tracked_malloc(pick_size());
+    }
+}
+
+static void run(const char *name, void (*workload)(void), bool adaptive) {
+    mem_reset_brk();
+    mm_mallopt(MM_CHUNKSIZE_MIN, 1 << 10);
+    mm_mallopt(MM_CHUNKSIZE_MAX, adaptive ? 1 << 20 : 1 << 10);
+    if (!mm_init()) {
+        fprintf(stderr, "heap_growth: mm_init failed\n");
+        exit(1);
+    }
+
+    srand(1);
+    extensions = 0;
+    peak_heap = mem_heapsize();
+    workload();
+
+    printf("workload=%s chunksize=%s extensions=%zu peak_heap=%zu\n", name,
+           adaptive ? "adaptive" : "fixed", extensions, peak_heap);
+}
+
+int main(void) {
+    mem_init();
+    run("startup", startup, false);
+    run("startup", startup, true);
+    run("steady", steady, false);
+    run("steady", steady, true);
+    return 0;
+}
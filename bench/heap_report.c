@@ -0,0 +1,337 @@
+/**
+ * @file heap_report.c
+ * @brief Fragmentation report from the heap snapshots mm_snapshot writes
+ *
+ * Reads JSON lines written by mm_snapshot (for instance with mm_bench -S)
+ * and prints, for every snapshot, one summary line:
+ *
+ *     snapshot label=mixed ops=3332 heap_size=3189264 in_use=2734832
+ *     free=454416 free_blocks=127 largest_free=184736 fragmentation=0.5935
+ *     quick=0
+ *
+ * where fragmentation is 1 - largest_free / free, then one line per
+ * non-empty size class with its free blocks, bytes and the smallest and
+ * largest block on it:
+ *
+ *     class label=mixed ops=3332 class=2 blocks=11 bytes=528 smallest=48
+ *     largest=48
+ *
+ * and, for the last snapshot of each label (every snapshot with -a), a
+ * histogram of free block sizes in powers of two:
+ *
+ *     free_sizes label=mixed ops=101412 from=128 to=255 blocks=22 bytes=4080
+ *
+ * Read over time, the class lines show which classes are crowded and which
+ * stay empty (NUM_CLASS, SUB_BITS), and the histogram and largest_free how
+ * far the heap fragments between extensions (chunksize).
+ *
+ * Build and run:
+ *
+ *     cc -O2 bench/heap_report.c -o heap_report
+ *     ./heap_report [-a] [file]
+ *
+ * With no file the snapshots are read from standard input.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Flags of a snapshot block, as written by mm_snapshot */
+#define FLAG_ALLOC 0x01
+#define FLAG_QUICK 0x10
+
+/** @brief Powers of two in the free size histogram */
+#define BUCKETS 64
+
+/** @brief One block of a snapshot */
+typedef struct block {
+    size_t offset;
+    size_t size;
+    unsigned flags;
+} block_t;
+
+/** @brief One snapshot line, parsed */
+typedef struct snapshot {
+    char label[64];
+    size_t ops;
+    size_t heap_size;
+    block_t *blocks;
+    size_t num_blocks;
+    size_t cap_blocks;
+    /** @brief Offsets of every class's members, back to back */
+    size_t *members;
+    size_t num_members;
+    size_t cap_members;
+    /** @brief Members per class */
+    size_t *class_counts;
+    size_t num_classes;
+    size_t cap_classes;
+} snapshot_t;
+
+static void *grow(void *array, size_t *cap, size_t elem) {
+    *cap = *cap == 0 ? 1024 : 2 * *cap;
+    array = realloc(array, *cap * elem);
+    if (array == NULL) {
+        fprintf(stderr, "heap_report: out of memory\n");
+        exit(1);
+    }
+    return array;
+}
+
+static bool parse_number(char **p, size_t *value) {
+    char *end;
+    *value = strtoull(*p, &end, 10);
+    if (end == *p) {
+        return false;
+    }
+    *p = end;
+    return true;
+}
+
+/** @brief Moves past `key` and the colon after it */
+static char *find_key(char *line, const char *key) {
+    char *p = strstr(line, key);
+    return p == NULL ? NULL : p + strlen(key) + 1;
+}
+
+/**
+ * @brief Parses one line of mm_snapshot output into `snap`, reusing its
+ *        arrays.
+ * @return False if the line is not a snapshot
+ */
+static bool parse_snapshot(char *line, snapshot_t *snap) {
+    char *p;
+
+    snap->label[0] = '\0';
+    if ((p = find_key(line, "\"label\"")) != NULL && *p == '"') {
+        size_t n = strcspn(p + 1, "\"");
+        if (n >= sizeof(snap->label)) {
+            n = sizeof(snap->label) - 1;
+        }
+        memcpy(snap->label, p + 1, n);
+        snap->label[n] = '\0';
+    }
+    if ((p = find_key(line, "\"ops\"")) == NULL ||
+        !parse_number(&p, &snap->ops) ||
+        (p = find_key(line, "\"heap_size\"")) == NULL ||
+        !parse_number(&p, &snap->heap_size)) {
+        return false;
+    }
+
+    // "blocks":[[offset,size,flags],...]
+    if ((p = find_key(line, "\"blocks\"")) == NULL || *p++ != '[') {
+        return false;
+    }
+    snap->num_blocks = 0;
+    while (*p == '[' || *p == ',') {
+        if (*p == ',') {
+            p++;
+        }
+        size_t offset, size, flags;
+        if (*p++ != '[' || !parse_number(&p, &offset) || *p++ != ',' ||
+            !parse_number(&p, &size) || *p++ != ',' ||
+            !parse_number(&p, &flags) || *p++ != ']') {
+            return false;
+        }
+        if (snap->num_blocks == snap->cap_blocks) {
+            snap->blocks = grow(snap->blocks, &snap->cap_blocks,
+                                sizeof(block_t));
+        }
+        snap->blocks[snap->num_blocks++] =
+            (block_t){offset, size, (unsigned)flags};
+    }
+
+    // "classes":[[offset,...],...]
+    if ((p = find_key(line, "\"classes\"")) == NULL || *p++ != '[') {
+        return false;
+    }
+    snap->num_members = 0;
+    snap->num_classes = 0;
+    while (*p == '[' || *p == ',') {
+        if (*p == ',') {
+            p++;
+        }
+        if (*p++ != '[') {
+            return false;
+        }
+        if (snap->num_classes == snap->cap_classes) {
+            snap->class_counts = grow(snap->class_counts, &snap->cap_classes,
+                                      sizeof(size_t));
+        }
+        size_t count = 0;
+        size_t offset;
+        while (parse_number(&p, &offset)) {
+            if (snap->num_members == snap->cap_members) {
+                snap->members = grow(snap->members, &snap->cap_members,
+                                     sizeof(size_t));
+            }
+            snap->members[snap->num_members++] = offset;
+            count++;
+            if (*p == ',') {
+                p++;
+            }
+        }
+        if (*p++ != ']') {
+            return false;
+        }
+        snap->class_counts[snap->num_classes++] = count;
+    }
+    return true;
+}
+
+/** @brief The block at `offset`, by binary search, or NULL */
+static const block_t *find_block(const snapshot_t *snap, size_t offset) {
+    size_t lo = 0;
+    size_t hi = snap->num_blocks;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (snap->blocks[mid].offset < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < snap->num_blocks && snap->blocks[lo].offset == offset
+               ? &snap->blocks[lo]
+               : NULL;
+}
+
+static unsigned log2_floor(size_t x) {
+    unsigned log = 0;
+    while (x >>= 1) {
+        log++;
+    }
+    return log;
+}
+
+static void report_summary(const snapshot_t *snap) {
+    size_t in_use = 0, free_bytes = 0, free_blocks = 0, largest = 0;
+    size_t quick = 0;
+    for (size_t i = 0; i < snap->num_blocks; i++) {
+        const block_t *block = &snap->blocks[i];
+        if (block->flags & FLAG_QUICK) {
+            quick += block->size;
+        } else if (block->flags & FLAG_ALLOC) {
+            in_use += block->size;
+        } else {
+            free_bytes += block->size;
+            free_blocks++;
+            if (block->size > largest) {
+                largest = block->size;
+            }
+        }
+    }
+    printf("snapshot label=%s ops=%zu heap_size=%zu in_use=%zu free=%zu "
+           "free_blocks=%zu largest_free=%zu fragmentation=%.4f quick=%zu\n",
+           snap->label, snap->ops, snap->heap_size, in_use, free_bytes,
+           free_blocks, largest,
+           free_bytes ? 1.0 - (double)largest / free_bytes : 0.0, quick);
+}
+
+static void report_classes(const snapshot_t *snap) {
+    const size_t *member = snap->members;
+    for (size_t i = 0; i < snap->num_classes; i++) {
+        size_t bytes = 0, smallest = SIZE_MAX, largest = 0;
+        for (size_t j = 0; j < snap->class_counts[i]; j++, member++) {
+            const block_t *block = find_block(snap, *member);
+            if (block == NULL || (block->flags & FLAG_ALLOC)) {
+                fprintf(stderr,
+                        "heap_report: class %zu lists %zu, which is not a "
+                        "free block\n",
+                        i, *member);
+                continue;
+            }
+            bytes += block->size;
+            smallest = block->size < smallest ? block->size : smallest;
+            largest = block->size > largest ? block->size : largest;
+        }
+        if (snap->class_counts[i] != 0) {
+            printf("class label=%s ops=%zu class=%zu blocks=%zu bytes=%zu "
+                   "smallest=%zu largest=%zu\n",
+                   snap->label, snap->ops, i, snap->class_counts[i], bytes,
+                   smallest, largest);
+        }
+    }
+}
+
+static void report_histogram(const snapshot_t *snap) {
+    size_t blocks[BUCKETS] = {0};
+    size_t bytes[BUCKETS] = {0};
+    for (size_t i = 0; i < snap->num_blocks; i++) {
+        const block_t *block = &snap->blocks[i];
+        if ((block->flags & FLAG_ALLOC) == 0) {
+            unsigned b = log2_floor(block->size);
+            blocks[b]++;
+            bytes[b] += block->size;
+        }
+    }
+    for (unsigned b = 0; b < BUCKETS; b++) {
+        if (blocks[b] != 0) {
+            printf("free_sizes label=%s ops=%zu from=%zu to=%zu blocks=%zu "
+                   "bytes=%zu\n",
+                   snap->label, snap->ops, (size_t)1 << b,
+                   ((size_t)2 << b) - 1, blocks[b], bytes[b]);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bool all = false;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "-a") == 0) {
+        all = true;
+        arg++;
+    }
+    FILE *in = stdin;
+    if (arg < argc && (in = fopen(argv[arg], "r")) == NULL) {
+        perror(argv[arg]);
+        return 1;
+    }
+
+    // Two snapshots are kept, so that the last one of a label can still
+    // be reported once the next label starts
+    snapshot_t snaps[2] = {0};
+    snapshot_t *cur = &snaps[0];
+    snapshot_t *prev = &snaps[1];
+    bool have_prev = false;
+    char *line = NULL;
+    size_t cap = 0;
+    size_t lineno = 0;
+    while (getline(&line, &cap, in) != -1) {
+        lineno++;
+        if (!parse_snapshot(line, cur)) {
+            fprintf(stderr, "heap_report: line %zu is not a snapshot\n",
+                    lineno);
+            continue;
+        }
+        if (have_prev && !all && strcmp(prev->label, cur->label) != 0) {
+            report_histogram(prev);
+        }
+        report_summary(cur);
+        report_classes(cur);
+        if (all) {
+            report_histogram(cur);
+        }
+        snapshot_t *tmp = prev;
+        prev = cur;
+        cur = tmp;
+        have_prev = true;
+    }
+    if (have_prev && !all) {
+        report_histogram(prev);
+    }
+
+    free(line);
+    for (int i = 0; i < 2; i++) {
+        free(snaps[i].blocks);
+        free(snaps[i].members);
+        free(snaps[i].class_counts);
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file memlib.c
+ * @brief Stand-in for the course's memory system model
+ *
+ * The heap is one contiguous region of MAX_HEAP bytes of address space,
+ * reserved up front with mmap so that pages are only backed once touched.
+ * It is kept below the 32 GB that mm.c's mini block links can span.
+ * mem_sbrk moves a break through it like sbrk(2) does.
+ *
+ * None of these functions lock: mm.c only calls mem_sbrk with its heap
+ * lock held. It does read the break without the lock (to tell whether a
+ * pointer being freed is in the heap), so the break is read and written
+ * with relaxed atomics.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "memlib.h"
+
+/** @brief Address space reserved for the heap (bytes) */
+#define MAX_HEAP ((size_t)1 << 34)
+
+static char *mem_start_brk; /* first byte of the heap */
+static char *mem_brk;       /* one past the last byte of the heap */
+static char *mem_max_addr;  /* one past the largest legal heap address */
+
+/**
+ * @brief Reserves the address space for the heap.
+ */
+void mem_init(void) {
+    void *start = mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (start == MAP_FAILED) {
+        perror("mem_init: mmap");
+        exit(1);
+    }
+    mem_start_brk = start;
+    mem_brk = mem_start_brk;
+    mem_max_addr = mem_start_brk + MAX_HEAP;
+}
+
+/**
+ * @brief Releases the heap's address space.
+ */
+void mem_deinit(void) {
+    munmap(mem_start_brk, MAX_HEAP);
+    mem_start_brk = mem_brk = mem_max_addr = NULL;
+}
+
+/**
+ * @brief Moves the break by `incr` bytes.
+ * @return The old break, or (void *)-1 if the heap would leave its region
+ */
+void *mem_sbrk(intptr_t incr) {
+    char *old_brk = mem_brk;
+    if ((incr > 0 && (size_t)incr > (size_t)(mem_max_addr - mem_brk)) ||
+        (incr < 0 && (size_t)-incr > (size_t)(mem_brk - mem_start_brk))) {
+        return (void *)-1;
+    }
+    __atomic_store_n(&mem_brk, old_brk + incr, __ATOMIC_RELAXED);
+    return old_brk;
+}
+
+/**
+ * @brief Empties the heap without giving its pages back.
+ */
+void mem_reset_brk(void) {
+    __atomic_store_n(&mem_brk, mem_start_brk, __ATOMIC_RELAXED);
+}
+
+void *mem_heap_lo(void) {
+    return mem_start_brk;
+}
+
+void *mem_heap_hi(void) {
+    return __atomic_load_n(&mem_brk, __ATOMIC_RELAXED) - 1;
+}
+
+size_t mem_heapsize(void) {
+    return (size_t)(mem_brk - mem_start_brk);
+}
+
+size_t mem_pagesize(void) {
+    return (size_t)getpagesize();
+}
+
+void *mem_memset(void *ptr, int value, size_t n) {
+    return memset(ptr, value, n);
+}
+
+void *mem_memcpy(void *dst, const void *src, size_t n) {
+    return memcpy(dst, src, n);
+}
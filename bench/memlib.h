@@ -0,0 +1,26 @@
+/**
+ * @file memlib.h
+ * @brief Stand-in for the course's memory system model
+ *
+ * Provides the same interface as the driver's memlib so that mm.c can be
+ * built and benchmarked outside the course tree.
+ */
+
+#ifndef MEMLIB_H
+#define MEMLIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+void mem_init(void);
+void mem_deinit(void);
+void *mem_sbrk(intptr_t incr);
+void mem_reset_brk(void);
+void *mem_heap_lo(void);
+void *mem_heap_hi(void);
+size_t mem_heapsize(void);
+size_t mem_pagesize(void);
+void *mem_memset(void *ptr, int value, size_t n);
+void *mem_memcpy(void *dst, const void *src, size_t n);
+
+#endif /* MEMLIB_H */
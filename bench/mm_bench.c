@@ -0,0 +1,701 @@
+/**
+ * @file mm_bench.c
+ * @brief Trace-driven benchmark and replay harness for mm.c
+ *
+ * Replays allocation traces against mm_malloc/mm_free/mm_realloc/mm_calloc
+ * (on top of the memlib stand-in) and against the C library's allocator,
+ * and prints one JSON object per trace and allocator:
+ *
+ *     {"trace":"mixed","allocator":"mm","ops":400000,"ops_per_sec":...,
+ *      "peak_heap":...,"peak_live":...,"utilization":...,
+ *      "latency_ns":{"malloc":{"count":...,"p50":...,"p99":...,"p999":...},
+ *                    "free":{...},"realloc":{...},"calloc":{...}}}
+ *
+ * Each trace is replayed twice per allocator: first timing every call for
+ * the latency percentiles and sampling the footprint after every call for
+ * peak_heap, then untimed per operation for ops_per_sec. The footprint is
+ * the memlib heap plus mmapped blocks and slab runs for mm, and mallinfo2's arena plus
+ * mmapped bytes for the C library. utilization is peak_live (the most
+ * payload bytes live at once) over peak_heap. The harness keeps its own
+ * arrays in mmapped memory so that they do not count against the C
+ * library. The C library's heap cannot be reset between traces, so its
+ * peak_heap is only exact for the first trace of a run.
+ *
+ * Traces are files in the course's format (numeric header lines are
+ * skipped; "a id size", "f id", "r id size", plus "c id size" for calloc)
+ * or come from a built-in generator:
+ *
+ *     small    short-lived objects of at most 512 bytes, mostly under 128
+ *     mixed    70% small, 25% up to 4 KB, 5% up to 512 KB
+ *     realloc  buffers grown with realloc (string builders, vectors)
+ *     phased   ramp-up, steady churn, then everything freed
+ *
+ * Build and run:
+ *
+ *     cc -O2 -DDRIVER -I. -Ibench mm.c bench/memlib.c bench/mm_bench.c \
+ *        -o mm_bench
+ *     ./mm_bench [-l] [-L] [-n ops] [-s seed] [-w dir] [-S file]
+ *                [-g generator]... [trace]...
+ *
+ * -l skips the C library run, -w writes the generated traces to `dir` so
+ * they can be replayed later, -S writes SNAPSHOTS mm_snapshot lines per
+ * trace to `file` (replacing it) for bench/heap_report.c. -L prints mm_latency_print after
+ * each trace, the allocator's own histograms per path for the untimed
+ * replay; build with -DMM_LATENCY for it to have any. With no -g and no
+ * trace files every generator runs. Built with -DMM_HARDEN, the allocator
+ * is reported as "mm-hardened".
+ */
+
+#define _GNU_SOURCE
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/** @brief One allocator call in a trace */
+typedef struct op {
+    /** @brief 'a' malloc, 'f' free, 'r' realloc, 'c' calloc */
+    char type;
+    /** @brief The allocation the call works on */
+    uint32_t id;
+    /** @brief Requested size, for every type but free */
+    size_t size;
+} op_t;
+
+/** @brief A trace: a name, its operations and how many ids it uses */
+typedef struct trace {
+    char name[64];
+    op_t *ops;
+    size_t num_ops;
+    size_t cap_ops;
+    uint32_t num_ids;
+} trace_t;
+
+/** @brief Operation types, in the order they are reported */
+enum { OP_MALLOC, OP_FREE, OP_REALLOC, OP_CALLOC, NUM_OP_TYPES };
+
+static const char *const op_names[NUM_OP_TYPES] = {"malloc", "free",
+                                                   "realloc", "calloc"};
+
+/** @brief An allocator under test */
+typedef struct allocator {
+    const char *name;
+    void *(*malloc)(size_t);
+    void (*free)(void *);
+    void *(*realloc)(void *, size_t);
+    void *(*calloc)(size_t, size_t);
+    /** @brief Starts from an empty heap */
+    void (*reset)(void);
+    /** @brief Bytes the allocator holds from the system right now */
+    size_t (*footprint)(void);
+} allocator_t;
+
+static void mm_reset(void) {
+    mem_reset_brk();
+    if (!mm_init()) {
+        fprintf(stderr, "mm_bench: mm_init failed\n");
+        exit(1);
+    }
+}
+
+static size_t mm_footprint(void) {
+    mm_stats_t stats;
+    mm_stats(&stats);
+    return mem_heapsize() + stats.mmap_bytes + stats.slab_size;
+}
+
+static void libc_reset(void) {
+    malloc_trim(0);
+}
+
+static size_t libc_footprint(void) {
+    struct mallinfo2 info = mallinfo2();
+    return info.arena + info.hblkhd;
+}
+
+/*
+ * A build with -DMM_HARDEN reports mm under its own name, so that its lines
+ * can be set against an unhardened build's to see what the checks cost.
+ */
+#ifdef MM_HARDEN
+#define MM_NAME "mm-hardened"
+#else
+#define MM_NAME "mm"
+#endif
+
+static const allocator_t allocators[] = {
+    {MM_NAME, mm_malloc, mm_free, mm_realloc, mm_calloc, mm_reset, mm_footprint},
+    {"libc", malloc, free, realloc, calloc, libc_reset, libc_footprint},
+};
+
+/*
+ * ---------------------------------------------------------------------------
+ *                        TRACES
+ * ---------------------------------------------------------------------------
+ */
+
+/**
+ * @brief Zeroed memory for the harness itself, kept out of both heaps.
+ *
+ * Resizes `old` (of `old_size` bytes) when it is not NULL.
+ */
+static void *bench_mem(void *old, size_t old_size, size_t size) {
+    void *mem = old == NULL
+                    ? mmap(NULL, size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                    : mremap(old, old_size, size, MREMAP_MAYMOVE);
+    if (mem == MAP_FAILED) {
+        perror("mm_bench");
+        exit(1);
+    }
+    return mem;
+}
+
+static void bench_release(void *mem, size_t size) {
+    if (mem != NULL) {
+        munmap(mem, size);
+    }
+}
+
+static void trace_push(trace_t *trace, char type, uint32_t id, size_t size) {
+    if (trace->num_ops == trace->cap_ops) {
+        size_t old_cap = trace->cap_ops;
+        trace->cap_ops = old_cap ? 2 * old_cap : 1024;
+        trace->ops = bench_mem(trace->ops, old_cap * sizeof(op_t),
+                               trace->cap_ops * sizeof(op_t));
+    }
+    trace->ops[trace->num_ops++] = (op_t){type, id, size};
+    if (id >= trace->num_ids) {
+        trace->num_ids = id + 1;
+    }
+}
+
+/**
+ * @brief Reads a trace file in the course's format.
+ */
+static bool trace_read(trace_t *trace, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    const char *base = strrchr(path, '/');
+    snprintf(trace->name, sizeof(trace->name), "%s", base ? base + 1 : path);
+
+    char line[256];
+    size_t lineno = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char type;
+        unsigned long id;
+        size_t size = 0;
+        lineno++;
+        if (sscanf(line, " %c", &type) != 1 || type == '#' ||
+            (type >= '0' && type <= '9')) {
+            continue; // blank, comment or header line
+        }
+        int fields = sscanf(line, " %c %lu %zu", &type, &id, &size);
+        if ((type == 'f' && fields < 2) ||
+            ((type == 'a' || type == 'r' || type == 'c') && fields < 3) ||
+            strchr("afrc", type) == NULL) {
+            fprintf(stderr, "%s:%zu: bad line\n", path, lineno);
+            fclose(file);
+            return false;
+        }
+        trace_push(trace, type, (uint32_t)id, size);
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * @brief Writes a trace in the course's format, headed by the number of
+ *        ids and operations.
+ */
+static void trace_write(const trace_t *trace, const char *dir) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.rep", dir, trace->name);
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return;
+    }
+    fprintf(file, "%u\n%zu\n", trace->num_ids, trace->num_ops);
+    for (size_t i = 0; i < trace->num_ops; i++) {
+        const op_t *op = &trace->ops[i];
+        if (op->type == 'f') {
+            fprintf(file, "f %u\n", op->id);
+        } else {
+            fprintf(file, "%c %u %zu\n", op->type, op->id, op->size);
+        }
+    }
+    fclose(file);
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ *                        GENERATORS
+ * ---------------------------------------------------------------------------
+ */
+
+static uint64_t rng_state;
+
+static uint64_t next_rand(void) {
+    uint64_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    rng_state = x;
+    return x;
+}
+
+/** @brief Uniform in [lo, hi] */
+static size_t rand_range(size_t lo, size_t hi) {
+    return lo + next_rand() % (hi - lo + 1);
+}
+
+/** @brief Objects of at most 512 bytes, most under 128, a few exact sizes
+ *         very common (the shape of a typical small-object heap) */
+static size_t small_size(void) {
+    static const size_t common[] = {8, 16, 24, 32, 48, 64, 96, 128};
+    uint64_t r = next_rand() % 100;
+    if (r < 60) {
+        return common[next_rand() % 8];
+    }
+    if (r < 90) {
+        return rand_range(1, 128);
+    }
+    return rand_range(129, 512);
+}
+
+static size_t mixed_size(void) {
+    uint64_t r = next_rand() % 100;
+    if (r < 70) {
+        return small_size();
+    }
+    if (r < 95) {
+        return rand_range(129, 4096);
+    }
+    return rand_range(4097, 512 * 1024);
+}
+
+/**
+ * @brief Random churn over a working set of `live` slots: each step frees
+ *        a random slot if it is in use and allocates it otherwise.
+ */
+static void gen_churn(trace_t *trace, size_t num_ops, uint32_t live,
+                      size_t (*size)(void)) {
+    bool *used = calloc(live, sizeof(bool));
+    while (trace->num_ops < num_ops) {
+        uint32_t id = (uint32_t)(next_rand() % live);
+        if (used[id]) {
+            trace_push(trace, 'f', id, 0);
+        } else if (next_rand() % 20 == 0) {
+            trace_push(trace, 'c', id, size());
+        } else {
+            trace_push(trace, 'a', id, size());
+        }
+        used[id] = !used[id];
+    }
+    for (uint32_t id = 0; id < live; id++) {
+        if (used[id]) {
+            trace_push(trace, 'f', id, 0);
+        }
+    }
+    free(used);
+}
+
+static void gen_small(trace_t *trace, size_t num_ops) {
+    gen_churn(trace, num_ops, 10000, small_size);
+}
+
+static void gen_mixed(trace_t *trace, size_t num_ops) {
+    gen_churn(trace, num_ops, 4000, mixed_size);
+}
+
+/**
+ * @brief Buffers that start small and grow by realloc until they reach a
+ *        random final size, interleaved with small objects.
+ */
+static void gen_realloc(trace_t *trace, size_t num_ops) {
+    const uint32_t buffers = 64;
+    const uint32_t objects = 4096;
+    size_t *len = calloc(buffers, sizeof(size_t));
+    size_t *target = calloc(buffers, sizeof(size_t));
+    bool *used = calloc(objects, sizeof(bool));
+
+    while (trace->num_ops < num_ops) {
+        uint32_t b = (uint32_t)(next_rand() % buffers);
+        if (len[b] == 0) {
+            len[b] = rand_range(16, 64);
+            target[b] = rand_range(1024, 256 * 1024);
+            trace_push(trace, 'a', b, len[b]);
+        } else if (len[b] >= target[b]) {
+            trace_push(trace, 'f', b, 0);
+            len[b] = 0;
+        } else {
+            // Vectors double, string builders append a little at a time
+            len[b] = (b % 2) ? 2 * len[b] : len[b] + rand_range(1, 256);
+            trace_push(trace, 'r', b, len[b]);
+        }
+
+        uint32_t id = buffers + (uint32_t)(next_rand() % objects);
+        trace_push(trace, used[id - buffers] ? 'f' : 'a', id, small_size());
+        used[id - buffers] = !used[id - buffers];
+    }
+
+    for (uint32_t b = 0; b < buffers; b++) {
+        if (len[b] != 0) {
+            trace_push(trace, 'f', b, 0);
+        }
+    }
+    for (uint32_t i = 0; i < objects; i++) {
+        if (used[i]) {
+            trace_push(trace, 'f', buffers + i, 0);
+        }
+    }
+    free(len);
+    free(target);
+    free(used);
+}
+
+/**
+ * @brief A program's life: a quarter of the operations build up a large
+ *        heap, half churn it, and the rest tear everything down.
+ */
+static void gen_phased(trace_t *trace, size_t num_ops) {
+    uint32_t live = (uint32_t)(num_ops / 4);
+    for (uint32_t id = 0; id < live; id++) {
+        trace_push(trace, 'a', id, mixed_size() % 2048 + 1);
+    }
+    for (size_t i = 0; i < num_ops / 4; i++) {
+        uint32_t id = (uint32_t)(next_rand() % live);
+        trace_push(trace, 'f', id, 0);
+        trace_push(trace, 'a', id, mixed_size() % 2048 + 1);
+    }
+    for (uint32_t id = 0; id < live; id++) {
+        trace_push(trace, 'f', id, 0);
+    }
+}
+
+/** @brief A built-in trace generator */
+typedef struct generator {
+    const char *name;
+    void (*generate)(trace_t *trace, size_t num_ops);
+} generator_t;
+
+static const generator_t generators[] = {
+    {"small", gen_small},
+    {"mixed", gen_mixed},
+    {"realloc", gen_realloc},
+    {"phased", gen_phased},
+};
+
+#define NUM_GENERATORS (sizeof(generators) / sizeof(generators[0]))
+
+/*
+ * ---------------------------------------------------------------------------
+ *                        REPLAY
+ * ---------------------------------------------------------------------------
+ */
+
+/** @brief Heap snapshots taken per trace with -S */
+#define SNAPSHOTS 32
+
+static FILE *snapshot_out;
+static bool print_latency;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/** @brief Latencies of one operation type */
+typedef struct samples {
+    uint64_t *ns;
+    size_t count;
+} samples_t;
+
+/** @brief Results of replaying one trace on one allocator */
+typedef struct result {
+    double ops_per_sec;
+    size_t peak_heap;
+    size_t peak_live;
+    samples_t latency[NUM_OP_TYPES];
+} result_t;
+
+static int op_index(char type) {
+    switch (type) {
+    case 'a':
+        return OP_MALLOC;
+    case 'f':
+        return OP_FREE;
+    case 'r':
+        return OP_REALLOC;
+    default:
+        return OP_CALLOC;
+    }
+}
+
+/**
+ * @brief Performs one operation of a trace.
+ *
+ * Writes the first bytes of every new block as a program would, and keeps
+ * track of the payload bytes that are live.
+ */
+static void replay_op(const allocator_t *alloc, const op_t *op, void **ptrs,
+                      size_t *sizes, size_t *live) {
+    void *ptr;
+    switch (op->type) {
+    case 'a':
+    case 'c':
+        ptr = op->type == 'a' ? alloc->malloc(op->size)
+                              : alloc->calloc(1, op->size);
+        if (ptr == NULL && op->size != 0) {
+            fprintf(stderr, "mm_bench: %s ran out of memory\n", alloc->name);
+            exit(1);
+        }
+        if (ptr != NULL) {
+            memset(ptr, 0x5a, op->size < 16 ? op->size : 16);
+        }
+        ptrs[op->id] = ptr;
+        sizes[op->id] = op->size;
+        *live += op->size;
+        break;
+    case 'r':
+        ptr = alloc->realloc(ptrs[op->id], op->size);
+        if (ptr == NULL && op->size != 0) {
+            fprintf(stderr, "mm_bench: %s ran out of memory\n", alloc->name);
+            exit(1);
+        }
+        ptrs[op->id] = ptr;
+        *live += op->size - sizes[op->id];
+        sizes[op->id] = op->size;
+        break;
+    default:
+        alloc->free(ptrs[op->id]);
+        ptrs[op->id] = NULL;
+        *live -= sizes[op->id];
+        sizes[op->id] = 0;
+        break;
+    }
+}
+
+static void replay(const allocator_t *alloc, const trace_t *trace,
+                   result_t *result) {
+    size_t ids_bytes = trace->num_ids * sizeof(void *);
+    size_t ns_bytes = trace->num_ops * sizeof(uint64_t);
+    void **ptrs = bench_mem(NULL, 0, ids_bytes);
+    size_t *sizes = bench_mem(NULL, 0, ids_bytes);
+    size_t live = 0;
+
+    // Latency and footprint, one call at a time
+    alloc->reset();
+    result->peak_heap = 0;
+    result->peak_live = 0;
+    for (int t = 0; t < NUM_OP_TYPES; t++) {
+        result->latency[t].ns = bench_mem(NULL, 0, ns_bytes);
+        result->latency[t].count = 0;
+    }
+    for (size_t i = 0; i < trace->num_ops; i++) {
+        const op_t *op = &trace->ops[i];
+        uint64_t before = now_ns();
+        replay_op(alloc, op, ptrs, sizes, &live);
+        uint64_t after = now_ns();
+
+        samples_t *samples = &result->latency[op_index(op->type)];
+        samples->ns[samples->count++] = after - before;
+        size_t footprint = alloc->footprint();
+        if (footprint > result->peak_heap) {
+            result->peak_heap = footprint;
+        }
+        if (live > result->peak_live) {
+            result->peak_live = live;
+        }
+        // Snapshot k is taken after op (k + 1) * num_ops / SNAPSHOTS
+        if (snapshot_out != NULL && alloc == &allocators[0] &&
+            (i + 1) * SNAPSHOTS / trace->num_ops !=
+                i * SNAPSHOTS / trace->num_ops) {
+            mm_snapshot(snapshot_out, trace->name);
+        }
+    }
+    for (uint32_t id = 0; id < trace->num_ids; id++) {
+        alloc->free(ptrs[id]);
+    }
+
+    // Throughput, without per-call timers in the way
+    alloc->reset();
+    memset(ptrs, 0, ids_bytes);
+    memset(sizes, 0, ids_bytes);
+    live = 0;
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < trace->num_ops; i++) {
+        replay_op(alloc, &trace->ops[i], ptrs, sizes, &live);
+    }
+    uint64_t elapsed = now_ns() - start;
+    result->ops_per_sec = trace->num_ops / (elapsed * 1e-9);
+    for (uint32_t id = 0; id < trace->num_ids; id++) {
+        alloc->free(ptrs[id]);
+    }
+
+    bench_release(ptrs, ids_bytes);
+    bench_release(sizes, ids_bytes);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/** @brief The value below which `permille` thousandths of samples fall */
+static uint64_t percentile(const samples_t *samples, unsigned permille) {
+    if (samples->count == 0) {
+        return 0;
+    }
+    size_t rank = samples->count * permille / 1000;
+    if (rank >= samples->count) {
+        rank = samples->count - 1;
+    }
+    return samples->ns[rank];
+}
+
+static void report(const char *trace, const allocator_t *alloc,
+                   size_t num_ops, result_t *result) {
+    size_t ns_bytes = num_ops * sizeof(uint64_t);
+    printf("{\"trace\":\"%s\",\"allocator\":\"%s\",\"ops\":%zu,"
+           "\"ops_per_sec\":%.0f,\"peak_heap\":%zu,\"peak_live\":%zu,"
+           "\"utilization\":%.4f,\"latency_ns\":{",
+           trace, alloc->name, num_ops, result->ops_per_sec,
+           result->peak_heap, result->peak_live,
+           result->peak_heap ? (double)result->peak_live / result->peak_heap
+                             : 0.0);
+    for (int t = 0; t < NUM_OP_TYPES; t++) {
+        samples_t *samples = &result->latency[t];
+        qsort(samples->ns, samples->count, sizeof(uint64_t), compare_u64);
+        printf("%s\"%s\":{\"count\":%zu,\"p50\":%lu,\"p99\":%lu,"
+               "\"p999\":%lu}",
+               t == 0 ? "" : ",", op_names[t], samples->count,
+               (unsigned long)percentile(samples, 500),
+               (unsigned long)percentile(samples, 990),
+               (unsigned long)percentile(samples, 999));
+        bench_release(samples->ns, ns_bytes);
+    }
+    printf("}}\n");
+    fflush(stdout);
+}
+
+static void run_trace(const trace_t *trace, bool with_libc) {
+    size_t runs = with_libc ? 2 : 1;
+    for (size_t i = 0; i < runs; i++) {
+        result_t result;
+        replay(&allocators[i], trace, &result);
+        report(trace->name, &allocators[i], trace->num_ops, &result);
+        if (print_latency && i == 0) {
+            mm_latency_print(stdout);
+        }
+    }
+    if (!mm_checkheap(__LINE__)) {
+        fprintf(stderr, "mm_bench: heap check failed after %s\n",
+                trace->name);
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv) {
+    bool with_libc = true;
+    size_t num_ops = 400000;
+    const char *write_dir = NULL;
+    const char *gens[NUM_GENERATORS];
+    size_t num_gens = 0;
+    int opt;
+
+    rng_state = 88172645463325252ULL;
+    while ((opt = getopt(argc, argv, "lLn:s:w:S:g:")) != -1) {
+        switch (opt) {
+        case 'l':
+            with_libc = false;
+            break;
+        case 'L':
+            print_latency = true;
+            break;
+        case 'n':
+            num_ops = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            rng_state = strtoull(optarg, NULL, 0) | 1;
+            break;
+        case 'w':
+            write_dir = optarg;
+            break;
+        case 'S':
+            snapshot_out = fopen(optarg, "w");
+            if (snapshot_out == NULL) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        case 'g':
+            if (num_gens < NUM_GENERATORS) {
+                gens[num_gens++] = optarg;
+            }
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-l] [-L] [-n ops] [-s seed] [-w dir] [-S file] "
+                    "[-g generator]... [trace]...\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (num_gens == 0 && optind == argc) {
+        for (size_t i = 0; i < NUM_GENERATORS; i++) {
+            gens[num_gens++] = generators[i].name;
+        }
+    }
+
+    mem_init();
+
+    for (size_t g = 0; g < num_gens; g++) {
+        const generator_t *gen = NULL;
+        for (size_t i = 0; i < NUM_GENERATORS; i++) {
+            if (strcmp(generators[i].name, gens[g]) == 0) {
+                gen = &generators[i];
+            }
+        }
+        if (gen == NULL) {
+            fprintf(stderr, "mm_bench: no generator named %s\n", gens[g]);
+            return 1;
+        }
+
+        trace_t trace = {0};
+        snprintf(trace.name, sizeof(trace.name), "%s", gen->name);
+        gen->generate(&trace, num_ops);
+        if (write_dir != NULL) {
+            trace_write(&trace, write_dir);
+        }
+        run_trace(&trace, with_libc);
+        bench_release(trace.ops, trace.cap_ops * sizeof(op_t));
+    }
+
+    for (int i = optind; i < argc; i++) {
+        trace_t trace = {0};
+        if (!trace_read(&trace, argv[i])) {
+            return 1;
+        }
+        run_trace(&trace, with_libc);
+        bench_release(trace.ops, trace.cap_ops * sizeof(op_t));
+    }
+    if (snapshot_out != NULL) {
+        fclose(snapshot_out);
+    }
+    return 0;
+}
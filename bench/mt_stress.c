@@ -0,0 +1,162 @@
+/**
+ * @file mt_stress.c
+ * @brief Multi-threaded malloc/free throughput benchmark
+ *
+ * Every thread churns its own working set of small and medium blocks and
+ * the run is repeated for 1, 2, 4, ... threads, so the output shows how
+ * throughput scales with the thread count. One line per run:
+ *
+ *     allocator=mm threads=4 ops=8000000 secs=0.412 mops=19.42
+ *
+ * Build (thread-safe allocator, then glibc for comparison with -g):
+ *
+ *     cc -O2 -DDRIVER -DMM_THREADS -I. -Ibench mm.c bench/memlib.c \
+ *        bench/mt_stress.c -o mt_stress -lpthread
+ *     ./mt_stress [-g] [-t max_threads] [-n ops_per_thread]
+ *
+ * Add -DMM_HARDEN to measure the hardened allocator (allocator=mm-hardened).
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/* A build with -DMM_HARDEN is reported as allocator=mm-hardened */
+#ifdef MM_HARDEN
+#define MM_NAME "mm-hardened"
+#else
+#define MM_NAME "mm"
+#endif
+
+/** @brief Live blocks each thread keeps around */
+#define SLOTS 1024
+
+static bool use_libc = false;
+static long ops_per_thread = 2000000;
+
+static void *bench_malloc(size_t size) {
+    return use_libc ? malloc(size) : mm_malloc(size);
+}
+
+static void bench_free(void *ptr) {
+    if (use_libc) {
+        free(ptr);
+    } else {
+        mm_free(ptr);
+    }
+}
+
+/**
+ * @brief xorshift64, so threads do not contend on rand()'s state
+ */
+static uint64_t next_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/**
+ * @brief Picks a request size: mostly small objects, some up to 4 KB
+ */
+static size_t pick_size(uint64_t *state) {
+    uint64_t r = next_rand(state);
+    if (r % 10 != 0) {
+        return 8 + (r >> 8) % 248;
+    }
+    return 256 + (r >> 8) % 3840;
+}
+
+static void *worker(void *arg) {
+    uint64_t state = (uintptr_t)arg * 0x9E3779B97F4A7C15ULL + 1;
+    void *slots[SLOTS] = {NULL};
+
+    for (long i = 0; i < ops_per_thread; i++) {
+        size_t slot = next_rand(&state) % SLOTS;
+        if (slots[slot] == NULL) {
+            size_t size = pick_size(&state);
+            slots[slot] = bench_malloc(size);
+            if (slots[slot] == NULL) {
+                fprintf(stderr, "mt_stress: out of memory\n");
+                exit(1);
+            }
+            // Touch the block like a real user would
+            memset(slots[slot], (int)i, size < 64 ? size : 64);
+        } else {
+            bench_free(slots[slot]);
+            slots[slot] = NULL;
+        }
+    }
+
+    for (size_t slot = 0; slot < SLOTS; slot++) {
+        bench_free(slots[slot]);
+    }
+    return NULL;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    long max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "gt:n:")) != -1) {
+        switch (opt) {
+        case 'g':
+            use_libc = true;
+            break;
+        case 't':
+            max_threads = atol(optarg);
+            break;
+        case 'n':
+            ops_per_thread = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-g] [-t max_threads] [-n ops]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    mem_init();
+    if (!mm_init()) {
+        fprintf(stderr, "mt_stress: mm_init failed\n");
+        return 1;
+    }
+
+    pthread_t *threads = calloc((size_t)max_threads, sizeof(*threads));
+    for (long nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        double start = now();
+        for (long t = 0; t < nthreads; t++) {
+            pthread_create(&threads[t], NULL, worker, (void *)(uintptr_t)t);
+        }
+        for (long t = 0; t < nthreads; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        double secs = now() - start;
+        long ops = nthreads * ops_per_thread;
+        printf("allocator=%s threads=%ld ops=%ld secs=%.3f mops=%.2f\n",
+               use_libc ? "libc" : MM_NAME, nthreads, ops, secs,
+               ops / secs / 1e6);
+    }
+    free(threads);
+
+    if (!use_libc && !mm_checkheap(__LINE__)) {
+        fprintf(stderr, "mt_stress: heap check failed\n");
+        return 1;
+    }
+    return 0;
+}
@@ -19,15 +19,25 @@
  * @author Abhishek Hemlani ahemlani@andrew.cmu.edu
  */
 
+#define _GNU_SOURCE /* for mremap */
+
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <execinfo.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
+
 #include "memlib.h"
 #include "mm.h"
 
@@ -46,6 +56,15 @@
 
 /* You can change anything from here onward */
 
+#ifdef DRIVER
+/* aliases for the rest of the interface in mm.h */
+#define memalign mm_memalign
+#define aligned_alloc mm_aligned_alloc
+#define posix_memalign mm_posix_memalign
+#define free_sized mm_free_sized
+#define free_aligned_sized mm_free_aligned_sized
+#endif /* def DRIVER */
+
 /*
  *****************************************************************************
  * If DEBUG is defined (such as when running mdriver-dbg), these macros      *
@@ -83,7 +102,72 @@
 #endif
 
 #define NUM_AHEAD 5
-#define NUM_CLASS 15
+#define NUM_PROBE 8
+
+/*
+ * Size classes, two levels as in TLSF. Blocks below 2^(SUB_BITS + 4) bytes
+ * get one class per multiple of 16 (class 0 holds the mini blocks). Every
+ * power of two from there up to 2^LARGE_LOG is split into 2^SUB_BITS
+ * equal sub-classes, and the last class holds all blocks of 2^LARGE_LOG
+ * bytes or more. SUB_BITS may be 1 to 3 (at most 64 classes); both can be
+ * overridden on the compiler command line.
+ */
+#ifndef SUB_BITS
+#define SUB_BITS 2
+#endif
+#ifndef LARGE_LOG
+#define LARGE_LOG 14
+#endif
+#define NUM_CLASS                                                              \
+    (((1 << SUB_BITS) - 1) + ((LARGE_LOG - SUB_BITS - 4) << SUB_BITS) + 1)
+
+/*
+ * Per-thread caches (MM_THREADS only): blocks of up to TCACHE_BINS * dsize
+ * bytes, at most TCACHE_FILL per size, moved TCACHE_BATCH at a time.
+ */
+#define TCACHE_BINS 16
+#define TCACHE_FILL 32
+#define TCACHE_BATCH 16
+
+/*
+ * Slabs for small requests: runs of SLAB_RUN bytes (SLAB_RUN aligned), each
+ * split into equal slots of (cls + 1) * dsize bytes for one of SLAB_CLASSES
+ * classes, carved from a region of SLAB_REGION bytes reserved on first use.
+ * The classes cover the same sizes as the per-thread cache bins, so every
+ * small request takes the same path.
+ */
+#define SLAB_CLASSES 16
+#define SLAB_RUN (1 << 12)
+#define SLAB_REGION ((size_t)1 << 30)
+
+/*
+ * Deferred coalescing: freed blocks of up to QUICK_BINS * dsize bytes can
+ * be kept on quick lists, one per size, instead of being merged right away.
+ */
+#define QUICK_BINS 64
+
+/*
+ * Arenas: each reserves ARENA_REGION bytes of address space, which bounds
+ * how far its heap can grow.
+ */
+#define ARENA_REGION ((size_t)1 << 32)
+
+/*
+ * Bump regions: chunks of REGION_CHUNK bytes are taken from the main heap;
+ * requests over REGION_CHUNK / 4 bytes get a chunk of their own.
+ */
+#define REGION_CHUNK (1 << 16)
+
+/*
+ * Allocation sampling: a sample keeps SAMPLE_DEPTH return addresses, at
+ * most SAMPLE_SITES distinct stacks and SAMPLE_LIVE live samples are
+ * tracked, and threads look at the sampling rate again every
+ * SAMPLE_RECHECK bytes while it is off.
+ */
+#define SAMPLE_DEPTH 32
+#define SAMPLE_SITES 4096
+#define SAMPLE_LIVE (1 << 16)
+#define SAMPLE_RECHECK (1 << 20)
 
 /* Basic constants */
 
@@ -98,14 +182,13 @@ static const size_t dsize = 2 * wsize;
 /** @brief Minimum block size (bytes) */
 static const size_t min_block_size = dsize; //change this to only dsize
 
-/**
- * TODO: explain what chunksize is
- * (Must be divisible by dsize)
- * 
- * chunk is the maximum number of blocks
- 
-*/
-static const size_t chunksize = (1 << 10);
+/** @brief Largest heap (bytes): mini-block links are 32-bit offsets in
+ *         units of dsize, so no two blocks may be further apart */
+static const size_t max_heap_size = (size_t)INT32_MAX * dsize;
+
+/** @brief Bounds on chunksize, set with mm_mallopt before mm_init */
+static size_t chunksize_min = (1 << 10);
+static size_t chunksize_max = (1 << 20);
 /**
  * TODO: explain what alloc_mask is
  */
@@ -115,10 +198,36 @@ static const word_t prev_mask = 0x02;
 
 static const word_t mini_prev_mask = 0x04;
 
+/** @brief Set in the header of a block that has its own mapping */
+static const word_t mmap_mask = 0x08;
+
+/**
+ * @brief Set in the header and footer of a free heap block whose bytes past
+ *        its list links are known to be zero. Heap blocks never have
+ *        mmap_mask set, so the two share a bit.
+ */
+static const word_t zero_mask = 0x08;
+
+/** @brief Extra flags of a block in mm_snapshot: zeroed free block, and
+ *         allocated block waiting on a quick list */
+static const unsigned snapshot_zeroed = 0x08;
+static const unsigned snapshot_quick = 0x10;
+
 /**
  * TODO: explain what size_mask is
+ *
+ * Under MM_HARDEN the top 16 bits of every header and footer hold a tag
+ * computed from the size (see header_tag), so sizes are limited to 48 bits.
  */
+#ifdef MM_HARDEN
+static const word_t size_mask = 0x0000FFFFFFFFFFF0;
+static const word_t tag_mask = 0xFFFF000000000000;
+static const bool hardened = true;
+#else
 static const word_t size_mask = ~(word_t)0xF;
+static const word_t tag_mask = 0;
+static const bool hardened = false;
+#endif
 
 /** @brief Represents the header and payload of one block in the heap */
 typedef struct block {
@@ -151,6 +260,25 @@ typedef struct block {
         struct block* next_list;
         struct block* prev_list;
         };        
+        /*
+         * A free mini block only has 8 bytes after its header, so its list
+         * links are 32-bit offsets from the block itself, in units of
+         * dsize (0 means NULL). This keeps the mini list doubly linked.
+         */
+        struct {
+        int32_t mini_next;
+        int32_t mini_prev;
+        };
+        /*
+         * Free blocks of the last class are nodes of a red-black tree
+         * ordered by size, then address (see tree_insert).
+         */
+        struct {
+        struct block *tree_left;
+        struct block *tree_right;
+        struct block *tree_parent;
+        bool tree_red;
+        };
         char payload[0];
     }; 
     
@@ -162,15 +290,355 @@ typedef struct block {
      */
 } block_t;
 
+/**
+ * @brief A block with its own mapping, used for large requests.
+ *
+ * The chunk sits at the start of the mapping and its block is never part
+ * of the heap: it is not reachable with find_next and never coalesced.
+ * All chunks are kept on one list so that the checker can find them.
+ */
+typedef struct mmap_chunk {
+    struct mmap_chunk *next;
+    struct mmap_chunk *prev;
+    /** @brief Bytes mapped, a multiple of the page size */
+    size_t length;
+    /** @brief Header (with mmap_mask set), then the payload */
+    block_t block;
+} mmap_chunk_t;
+
+/** @brief Mapping bytes in front of the payload of an mmap chunk */
+static const size_t mmap_overhead = offsetof(mmap_chunk_t, block) + wsize;
+
+/**
+ * @brief The header at the start of every slab run.
+ *
+ * The slots follow the header and have no header of their own: free finds
+ * the run by rounding the address down to SLAB_RUN, and the slot by
+ * dividing by the slot size.
+ */
+typedef struct slab_run {
+    /** @brief Links on slab_partial[cls], or (next only) on slab_empty */
+    struct slab_run *next;
+    struct slab_run *prev;
+    /** @brief Slot size, (cls + 1) * dsize */
+    uint32_t slot_size;
+    uint16_t num_slots;
+    uint16_t num_free;
+    uint32_t cls;
+    /** @brief Bit i is set when slot i is free */
+    word_t free_map[SLAB_RUN / 16 / 64];
+} slab_run_t;
+
+_Static_assert(sizeof(slab_run_t) % 16 == 0, "slots must be 16-byte aligned");
+
+/**
+ * @brief Everything that belongs to one heap: the main heap or an arena.
+ *
+ * The heap code works on whichever heap `heap` points to. The main heap
+ * grows in the memlib region; an arena grows in a region of its own,
+ * reserved when it is created, with its heap_t at the start.
+ */
+typedef struct heap {
+    /** @brief Pointer to first block in the heap */
+    block_t *heap_start;
+
+    /**@brief Pointer to seglist class sizes; for the last class, the root of
+     *        the tree of large free blocks */
+    block_t *seg_list[NUM_CLASS];
+
+    /** @brief Bit i is set exactly when seg_list[i] is non-empty */
+    word_t class_bitmap;
+
+    /** @brief Heap bytes from here on have never been written since they
+     *         were mapped, so they read zero. It only moves down when
+     *         trim_tail drops the pages above the break */
+    char *zero_brk;
+
+    /** @brief Freed blocks of (i + 1) * dsize bytes not yet coalesced,
+     *         linked by next_list; they stay marked allocated until they
+     *         are merged */
+    block_t *quick_list[QUICK_BINS];
+
+    /**
+     * @brief How far the heap grows when malloc finds no fit (bytes).
+     *
+     * Starts at chunksize_min. An extension that comes after little more
+     * than the previous one was allocated means the program is still
+     * ramping up, so chunksize doubles (up to chunksize_max and an eighth of
+     * the heap) and heap_sbrk is called less and less often. One that comes
+     * after the heap mostly recycled freed blocks halves it again, so a
+     * steady heap is never grown far past what it uses. Trimming the heap
+     * halves it too. (Must be divisible by dsize)
+     */
+    size_t chunksize;
+
+    /** @brief Bytes handed out by alloc_block since the heap last grew */
+    size_t alloc_since_extend;
+
+    /*
+     * Statistics, kept up to date as the heap changes so that mm_stats
+     * never walks the heap.
+     */
+
+    /** @brief Number of free blocks and free bytes on each seg_list class */
+    size_t class_blocks[NUM_CLASS];
+    size_t class_bytes[NUM_CLASS];
+
+    /** @brief Free bytes on all classes together */
+    size_t free_bytes;
+
+    /** @brief Blocks on the quick lists, and their bytes */
+    size_t quick_blocks;
+    size_t quick_bytes;
+
+    /** @brief Number of extend_heap calls, block splits, and frees that
+     *         merged with at least one neighbour */
+    size_t extend_count;
+    size_t split_count;
+    size_t coalesce_count;
+
+    /** @brief An arena's region: the heap runs from region_lo to region_brk,
+     *         and may grow up to region_end. NULL for the main heap */
+    char *region_lo;
+    char *region_brk;
+    char *region_end;
+} heap_t;
+
 /* Global variables */
-/** @brief Pointer to head of a seg list*/
-//static block_t *head = NULL;
-//static block_t *tail = NULL;
-/** @brief Pointer to first block in the heap */
-block_t *heap_start = NULL;
 
-/**@brief Pointer to seglist class sizes */
-block_t *seg_list[NUM_CLASS]; //do we change this to make it fewer class sizes/
+/** @brief The heap in the memlib region, used by malloc and free */
+static heap_t main_heap = {.chunksize = (1 << 10)};
+
+/** @brief The heap being worked on: the main heap, except while an arena
+ *         call holds the heap lock (see arena_enter) */
+static heap_t *heap = &main_heap;
+
+/** @brief The class whose free blocks are kept in a tree, not a list */
+static const size_t tree_class = NUM_CLASS - 1;
+
+/** @brief All blocks that have their own mapping */
+static mmap_chunk_t *mmap_chunks = NULL;
+
+/** @brief The slab region, NULL until the first small request. Runs are
+ *         carved from slab_base up to slab_brk; the rest is only reserved */
+static char *slab_base = NULL;
+static char *slab_brk = NULL;
+
+/** @brief Runs of each slab class that have a free slot */
+static slab_run_t *slab_partial[SLAB_CLASSES];
+
+/** @brief Runs with every slot free, ready for any class */
+static slab_run_t *slab_empty = NULL;
+
+/*
+ * Statistics, kept up to date as the heap changes so that mm_stats never
+ * walks the heap. Everything here is protected by the heap lock.
+ */
+
+/** @brief Number of blocks with their own mapping, and bytes mapped */
+static size_t mmap_count;
+static size_t mmap_bytes;
+
+/** @brief Slab runs carved so far, and bytes in slab slots in use */
+static size_t slab_runs;
+static size_t slab_bytes;
+
+/** @brief Calls of each public entry point */
+typedef struct op_counts {
+    size_t mallocs;
+    size_t frees;
+    size_t reallocs;
+    size_t callocs;
+} op_counts_t;
+
+/** @brief Entry point calls; in thread-safe mode only those of threads that
+ *         have exited, the rest are in each thread's cache */
+static op_counts_t op_counts;
+
+/** @brief Requests with an adjusted size of at least this many bytes are
+ *         mapped on their own (0 disables), see mm_mallopt */
+static size_t mmap_threshold = 128 * 1024;
+
+/** @brief Requests of at most this many bytes are served from slabs
+ *         (0 disables them, at most SLAB_CLASSES * dsize), see mm_mallopt */
+static size_t slab_max = SLAB_CLASSES * 16;
+
+/** @brief Freed blocks of at most this many bytes go on the quick lists
+ *         instead of being coalesced (0: always coalesce right away) */
+static size_t quick_max = 0;
+
+/** @brief The quick lists are merged once they hold more than this many
+ *         bytes */
+static size_t quick_limit = 64 * 1024;
+
+/** @brief A free tail block of this many bytes shrinks the heap (0: never) */
+static size_t trim_threshold = 128 * 1024;
+
+/** @brief Free bytes left at the end of the heap by an automatic trim */
+static size_t top_pad = 16 * 1024;
+
+/** @brief A free block of this many bytes elsewhere has its pages released
+ *         (0: never) */
+static size_t release_threshold = 1024 * 1024;
+
+/*
+ * One heap operation in check_rate has the blocks it touches checked, and
+ * one in check_full runs the whole of mm_checkheap (0: never), see
+ * check_op. Debug builds check every operation locally.
+ */
+#ifdef DEBUG
+static size_t check_rate = 1;
+static size_t check_full = 64;
+#else
+static size_t check_rate = 0;
+static size_t check_full = 0;
+#endif
+
+/** @brief Heap operations counted by check_op while checks are on */
+static size_t check_ops;
+
+/** @brief One bit per dsize of heap, set for free blocks by mm_checkheap */
+static uint64_t *check_map;
+static size_t check_map_bytes;
+
+_Static_assert(NUM_CLASS <= 64, "class_bitmap holds one bit per class");
+_Static_assert(NUM_CLASS <= MM_MAX_CLASSES, "mm_stats reports every class");
+
+/** @brief Bumped by mm_init so per-thread caches holding blocks of an old
+ *         heap are dropped instead of being handed out again */
+static unsigned long heap_generation;
+
+#ifdef MM_THREADS
+/** @brief Serializes every access to the shared heap and its free lists */
+static pthread_mutex_t heap_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void heap_lock(void) {
+    pthread_mutex_lock(&heap_mutex);
+}
+
+static void heap_unlock(void) {
+    pthread_mutex_unlock(&heap_mutex);
+}
+#else
+static void heap_lock(void) {
+}
+
+static void heap_unlock(void) {
+}
+#endif
+
+/*
+ * Latency histograms (MM_LATENCY only): malloc, free, realloc, calloc and
+ * the batch calls time themselves with latency_start and latency_end, and the code under
+ * them tells latency_end which path the call took with latency_set_path.
+ * Without MM_LATENCY all of these are empty and compile away.
+ */
+#ifdef MM_LATENCY
+/** @brief Calls per entry point, path and log2 of their nanoseconds */
+static size_t latency[MM_NUM_OPS][MM_NUM_PATHS][MM_LATENCY_BUCKETS];
+
+#ifdef MM_THREADS
+/** @brief The path of the calling thread's current call */
+static __thread int latency_path;
+#else
+static int latency_path;
+#endif
+
+/** @brief The monotonic clock in nanoseconds */
+static uint64_t latency_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Starts timing a call, with its path MM_PATH_OTHER until the call
+ *        sets one.
+ */
+static uint64_t latency_start(void) {
+    latency_path = MM_PATH_OTHER;
+    return latency_now();
+}
+
+static void latency_set_path(int path) {
+    latency_path = path;
+}
+
+/**
+ * @brief Counts a call of entry point `op` that started at `start` in the
+ *        bucket of its duration, under the last path set.
+ */
+static void latency_end(int op, uint64_t start) {
+    uint64_t ns = latency_now() - start;
+    unsigned bucket = ns == 0 ? 0 : 64 - (unsigned)__builtin_clzll(ns);
+    if (bucket >= MM_LATENCY_BUCKETS) {
+        bucket = MM_LATENCY_BUCKETS - 1;
+    }
+    __atomic_fetch_add(&latency[op][latency_path][bucket], 1,
+                       __ATOMIC_RELAXED);
+}
+
+static void latency_reset(void) {
+    memset(latency, 0, sizeof(latency));
+}
+#else
+static uint64_t latency_start(void) {
+    return 0;
+}
+
+static void latency_set_path(int path) {
+}
+
+static void latency_end(int op, uint64_t start) {
+}
+
+static void latency_reset(void) {
+}
+#endif
+
+/** @brief mem_heap_lo for the current heap */
+static void *heap_lo(void) {
+    return heap->region_lo == NULL ? mem_heap_lo() : heap->region_lo;
+}
+
+/** @brief mem_heap_hi for the current heap */
+static void *heap_hi(void) {
+    return heap->region_lo == NULL ? mem_heap_hi() : heap->region_brk - 1;
+}
+
+/** @brief mem_heapsize for the current heap */
+static size_t heap_size(void) {
+    return heap->region_lo == NULL
+               ? mem_heapsize()
+               : (size_t)(heap->region_brk - heap->region_lo);
+}
+
+/**
+ * @brief mem_sbrk for the current heap.
+ *
+ * The main heap grows in the memlib region; an arena's break moves the same
+ * way within the region reserved for it.
+ *
+ * @param[in] incr Bytes to grow the heap by (or shrink, if negative)
+ * @return The old break, or (void *)-1 if the region cannot grow or shrink
+ *         that far or the heap would outgrow max_heap_size
+ */
+static void *heap_sbrk(intptr_t incr) {
+    if (incr > 0 && (size_t)incr > max_heap_size - heap_size()) {
+        return (void *)-1;
+    }
+    if (heap->region_lo == NULL) {
+        return mem_sbrk(incr);
+    }
+
+    char *old_brk = heap->region_brk;
+    if ((incr > 0 && (size_t)incr > (size_t)(heap->region_end - old_brk)) ||
+        (incr < 0 && (size_t)-incr > (size_t)(old_brk - heap->region_lo))) {
+        return (void *)-1;
+    }
+    heap->region_brk += incr;
+    return old_brk;
+}
 
 
 
@@ -204,6 +672,16 @@ static size_t max(size_t x, size_t y) {
     return (x > y) ? x : y;
 }
 
+/**
+ * @brief Returns the minimum of two integers.
+ * @param[in] x
+ * @param[in] y
+ * @return `x` if `x < y`, and `y` otherwise.
+ */
+static size_t min(size_t x, size_t y) {
+    return (x < y) ? x : y;
+}
+
 /**
  * @brief Rounds `size` up to next multiple of n
  * @param[in] size
@@ -214,20 +692,86 @@ static size_t round_up(size_t size, size_t n) {
     return n * ((size + (n - 1)) / n);
 }
 
+/**
+ * @brief Converts a requested payload size into a block size.
+ *
+ * Allocated blocks carry only a header, so the block must fit the payload
+ * plus one word, rounded up to keep payloads 16-byte aligned.
+ *
+ * @param[in] size The number of payload bytes requested
+ * @return The adjusted block size
+ */
+static size_t adjust_size(size_t size) {
+    return max(round_up(size + wsize, dsize), min_block_size);
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ *                        HARDENED MODE
+ * ---------------------------------------------------------------------------
+ *
+ * Built with -DMM_HARDEN, every header and footer carries a 16-bit tag
+ * mixed from its size and a per-process key, and the allocator checks what
+ * it is about to trust: free and its variants check the tag, the alloc bit
+ * and the pointer's range and alignment; a block or slot pushed onto a quick
+ * list or per-thread bin is marked with the key and searched for on the list
+ * if it is pushed again; delete checks that a free block's neighbours on
+ * its list or tree lie in the heap and point back at it before unlinking
+ * it, and find_fit checks each link before following it; and a slab slot
+ * must be allocated in its run's bitmap to be freed. A failed check prints
+ * what was found and aborts. The key is the address of main_heap, which
+ * ASLR moves between runs: it stops stray writes and blind forgeries, not
+ * an attacker who can read the heap. Without MM_HARDEN, tag_mask and
+ * hardened are 0 and every check folds away.
+ */
+
+/**
+ * @brief The per-process key tags are mixed from.
+ */
+static word_t header_key(void) {
+    return (word_t)(uintptr_t)&main_heap;
+}
+
+/**
+ * @brief Returns the tag of a header or footer for a block of `size` bytes,
+ *        or 0 without MM_HARDEN.
+ */
+static word_t header_tag(size_t size) {
+    return ((size ^ header_key()) * 0x9E3779B97F4A7C15) & tag_mask;
+}
+
+/**
+ * @brief Returns whether a header or footer carries the tag of its size.
+ */
+static bool tag_ok(word_t word) {
+    return (word & tag_mask) == header_tag(word & size_mask);
+}
+
+/**
+ * @brief Reports a failed hardening check and aborts.
+ * @param[in] what What was found, e.g. "double free"
+ * @param[in] p The pointer or block it was found at
+ */
+static void harden_fail(const char *what, const void *p) {
+    fprintf(stderr, "mm: %s at %p\n", what, p);
+    abort();
+}
+
 /**
  * @brief Packs the `size` and `alloc` of a block into a word suitable for
  *        use as a packed value.
  *
  * Packed values are used for both headers and footers.
  *
- * The allocation status is packed into the lowest bit of the word.
+ * The allocation status is packed into the lowest bit of the word, and
+ * under MM_HARDEN the size's tag into the top 16.
  *
  * @param[in] size The size of the block being represented
  * @param[in] alloc True if the block is allocated
  * @return The packed value
  */
 static word_t pack(size_t size, bool alloc, bool prev_alloc, bool mini_prev) {
-    word_t word = size;
+    word_t word = size | header_tag(size);
     if (alloc) {
         word |= alloc_mask;
     }
@@ -240,11 +784,30 @@ static word_t pack(size_t size, bool alloc, bool prev_alloc, bool mini_prev) {
     return word;
 }
 
+/**
+ * @brief Reads a block's header.
+ *
+ * Free and mm_usable_size read the header of a live allocation without
+ * the heap lock, while a thread holding it may rewrite the prev bits in
+ * that header (write_block updates the next block's), so headers are read
+ * and written with relaxed atomics. These compile to plain moves.
+ */
+static word_t header_load(const block_t *block) {
+    return __atomic_load_n(&block->header, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Writes a block's header (see header_load).
+ */
+static void header_store(block_t *block, word_t header) {
+    __atomic_store_n(&block->header, header, __ATOMIC_RELAXED);
+}
+
 /**
  * @brief Extracts the size represented in a packed word.
  *
  * This function simply clears the lowest 4 bits of the word, as the heap
- * is 16-byte aligned.
+ * is 16-byte aligned (and, under MM_HARDEN, the tag).
  *
  * @param[in] word
  * @return The size of the block represented by the word
@@ -262,7 +825,7 @@ static size_t get_size(block_t *block)
 {
     dbg_requires(block != NULL);
 
-    return extract_size(block->header);
+    return extract_size(header_load(block));
 }
 
 /**
@@ -352,7 +915,44 @@ static bool extract_alloc(word_t word) {
  * @return The allocation status of the block
  */
 static bool get_alloc(block_t *block) {
-    return extract_alloc(block->header);
+    return extract_alloc(header_load(block));
+}
+
+/**
+ * @brief Returns whether an allocated block has its own mapping.
+ * @param[in] block
+ * @return True if the block was allocated by mmap_alloc
+ */
+static bool is_mmapped(block_t *block) {
+    return (header_load(block) & mmap_mask) != 0;
+}
+
+/**
+ * @brief Returns whether a free heap block is known to be zero past its
+ *        list links (from sizeof(block_t) up to the footer).
+ * @param[in] block
+ * @return True if the block has zero_mask set
+ */
+static bool get_zeroed(block_t *block) {
+    return !get_alloc(block) && (header_load(block) & zero_mask) != 0;
+}
+
+/**
+ * @brief Marks a free heap block as zero past its list links.
+ *
+ * Blocks too small to have any bytes past their links and footer are left
+ * unmarked, so that clearing a seam between two marked blocks (see
+ * clear_seam) never reaches beyond them.
+ *
+ * @param[in] block A free block whose bytes past its links are all zero
+ */
+static void set_zeroed(block_t *block) {
+    dbg_requires(!get_alloc(block));
+    if (get_size(block) < sizeof(block_t) + wsize) {
+        return;
+    }
+    header_store(block, header_load(block) | zero_mask);
+    *header_to_footer(block) |= zero_mask;
 }
 
 /**
@@ -364,8 +964,8 @@ static bool get_alloc(block_t *block) {
  */
 static void write_epilogue(block_t *block, bool is_mini) {
     dbg_requires(block != NULL);
-    dbg_requires((char *)block == (char *)mem_heap_hi() - 7);
-    block->header = pack(0, true, false, is_mini);
+    dbg_requires((char *)block == (char *)heap_hi() - 7);
+    header_store(block, pack(0, true, false, is_mini));
 }
 
 
@@ -435,7 +1035,7 @@ static block_t *find_prev(block_t *block) {
 }
 
 static bool get_prev_alloc(block_t* block){
-    word_t header = block->header & prev_mask;
+    word_t header = header_load(block) & prev_mask;
     if(header == 0){
         return false;
     }
@@ -445,12 +1045,86 @@ static bool get_prev_alloc(block_t* block){
  * @brief this function returns true if the prev block is a mini_block 
 */
 static bool get_mini_prev(block_t* block){ 
-    word_t header = block->header & mini_prev_mask;
+    word_t header = header_load(block) & mini_prev_mask;
     if(header == 0){
         return false;
     }
     return true; 
 }
+/**
+ * @brief Encodes a mini list link from `from` to `to`.
+ * @pre The two blocks are less than 32 GB apart, which heap_sbrk ensures
+ *      by keeping the heap within max_heap_size
+ */
+static int32_t mini_link(block_t *from, block_t *to) {
+    if (to == NULL) {
+        return 0;
+    }
+    ptrdiff_t delta = ((char *)to - (char *)from) / (ptrdiff_t)dsize;
+    dbg_assert(delta != 0 && delta == (int32_t)delta);
+    return (int32_t)delta;
+}
+
+/**
+ * @brief Decodes a mini list link stored in `from`.
+ */
+static block_t *mini_follow(block_t *from, int32_t link) {
+    if (link == 0) {
+        return NULL;
+    }
+    return (block_t *)((char *)from + (ptrdiff_t)link * (ptrdiff_t)dsize);
+}
+
+/**
+ * @brief Returns whether a free-list or tree link may be followed: it is
+ *        NULL, or it points at an aligned header in the heap whose size
+ *        keeps the block in the heap.
+ */
+static bool link_ok(block_t *link) {
+    if (link == NULL) {
+        return true;
+    }
+    char *p = (char *)link;
+    char *hi = (char *)heap_hi();
+    if (p < (char *)heap_lo() || p + dsize - 1 > hi ||
+        ((uintptr_t)p + wsize) % dsize != 0) {
+        return false;
+    }
+    size_t size = get_size(link);
+    return size >= dsize && size <= (size_t)(hi - p) + 1;
+}
+
+/**
+ * @brief Returns `link`, a link read out of `block`, after checking it with
+ *        link_ok in hardened mode.
+ */
+static block_t *safe_link(block_t *block, block_t *link) {
+    if (hardened && !link_ok(link)) {
+        harden_fail("corrupted free list", block);
+    }
+    return link;
+}
+
+/**
+ * @brief Returns the block after a free block on its seg_list.
+ */
+static block_t *list_next(block_t *block) {
+    if (get_size(block) == dsize) {
+        return mini_follow(block, block->mini_next);
+    }
+    return block->next_list;
+}
+
+/**
+ * @brief Returns the block before a free block on its seg_list.
+ */
+static block_t *list_prev(block_t *block) {
+    if (get_size(block) == dsize) {
+        return mini_follow(block, block->mini_prev);
+    }
+    return block->prev_list;
+}
+
 /**
  * @brief Writes a block starting at the given address.
  *
@@ -472,7 +1146,7 @@ static void write_block(block_t *block, size_t size, bool alloc, bool prev_alloc
         is_mini = true;
     }
     
-    block->header = pack(size, alloc,prev_alloc, mini_prev);
+    header_store(block, pack(size, alloc,prev_alloc, mini_prev));
 
     if(alloc == false && size > dsize){ //need to add a condition for footers only in payload > 16
         word_t *footerp = header_to_footer(block);
@@ -484,7 +1158,8 @@ static void write_block(block_t *block, size_t size, bool alloc, bool prev_alloc
     block_t* next_block = find_next(block);
     word_t next_size = get_size(next_block);
     bool next_alloc = get_alloc(next_block); 
-    find_next(block)->header = pack(next_size, next_alloc, alloc, is_mini); //packs the current information into the next block
+    word_t next_zero = get_zeroed(next_block) ? zero_mask : 0; // stays with the next block
+    header_store(next_block, pack(next_size, next_alloc, alloc, is_mini) | next_zero); //packs the current information into the next block
 
 }
 
@@ -497,16 +1172,537 @@ static void write_block(block_t *block, size_t size, bool alloc, bool prev_alloc
  * ---------------------------------------------------------------------------
  */
 
-/******** The remaining content below are helper and debug routines ********/
-
-/**
+/*
+ * ---------------------------------------------------------------------------
+ *                        SMALL OBJECT SLABS
+ * ---------------------------------------------------------------------------
+ *
+ * Requests of at most slab_max bytes are served from slab runs instead of
+ * the heap. A run holds slots of a single size, tracked by a free bitmap in
+ * the run header, so a slot costs no header, no boundary tags and no
+ * coalescing: malloc takes the lowest set bit of the first run with a free
+ * slot and free sets it again. Runs come from their own reserved region, so
+ * free tells a slot from a heap block with a range check. A run whose slots
+ * are all free again goes on slab_empty for any class to reuse, unless it
+ * is the last run of its class. Everything here needs the heap lock.
+ */
+
+/**
+ * @brief Returns the slab class for a request of `size` bytes.
+ */
+static size_t slab_class(size_t size) {
+    dbg_requires(size > 0 && size <= SLAB_CLASSES * dsize);
+    return (size - 1) / dsize;
+}
+
+/**
+ * @brief Returns whether `bp` points into the slab region.
+ *
+ * Safe without the heap lock: slab_base only changes in mm_init.
+ */
+static bool in_slab(const void *bp) {
+    const char *base = __atomic_load_n(&slab_base, __ATOMIC_RELAXED);
+    return base != NULL && (const char *)bp >= base &&
+           (const char *)bp < base + SLAB_REGION;
+}
+
+/**
+ * @brief Returns the run that holds the slot at `bp`.
+ */
+static slab_run_t *slab_run_of(const void *bp) {
+    dbg_requires(in_slab(bp));
+    return (slab_run_t *)((uintptr_t)bp & ~(uintptr_t)(SLAB_RUN - 1));
+}
+
+/**
+ * @brief Links a run at the head of its class's partial list.
+ */
+static void slab_link(slab_run_t *run) {
+    run->prev = NULL;
+    run->next = slab_partial[run->cls];
+    if (run->next != NULL) {
+        run->next->prev = run;
+    }
+    slab_partial[run->cls] = run;
+}
+
+/**
+ * @brief Unlinks a run from its class's partial list.
+ */
+static void slab_unlink(slab_run_t *run) {
+    if (run->prev != NULL) {
+        run->prev->next = run->next;
+    } else {
+        slab_partial[run->cls] = run->next;
+    }
+    if (run->next != NULL) {
+        run->next->prev = run->prev;
+    }
+}
+
+/**
+ * @brief Sets up an empty run for class `cls` and puts it on its partial
+ *        list.
+ *
+ * Reuses a run from slab_empty if there is one, and otherwise carves a new
+ * one from the region, reserving the region first if needed.
+ *
+ * @param[in] cls A slab class
+ * @return The run, or NULL if the region is exhausted or cannot be mapped
+ */
+static slab_run_t *slab_new_run(size_t cls) {
+    slab_run_t *run = slab_empty;
+    if (run != NULL) {
+        slab_empty = run->next;
+    } else {
+        if (slab_base == NULL) {
+            void *base = mmap(NULL, SLAB_REGION, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                              -1, 0);
+            if (base == MAP_FAILED) {
+                // Without a region every request goes to the heap
+                slab_max = 0;
+                return NULL;
+            }
+            slab_brk = base;
+            __atomic_store_n(&slab_base, (char *)base, __ATOMIC_RELAXED);
+        }
+        if (slab_brk == slab_base + SLAB_REGION) {
+            return NULL;
+        }
+        run = (slab_run_t *)slab_brk;
+        slab_brk += SLAB_RUN;
+        slab_runs++;
+    }
+
+    run->cls = cls;
+    run->slot_size = (cls + 1) * dsize;
+    run->num_slots = (SLAB_RUN - sizeof(slab_run_t)) / run->slot_size;
+    run->num_free = run->num_slots;
+    for (size_t i = 0; i < SLAB_RUN / 16 / 64; i++) {
+        size_t first = i * 64;
+        if (first >= run->num_slots) {
+            run->free_map[i] = 0;
+        } else if (run->num_slots - first >= 64) {
+            run->free_map[i] = ~(word_t)0;
+        } else {
+            run->free_map[i] = ((word_t)1 << (run->num_slots - first)) - 1;
+        }
+    }
+    slab_link(run);
+    return run;
+}
+
+/**
+ * @brief Allocates a slot of slab class `cls`.
+ * @param[in] cls A slab class
+ * @return The slot, or NULL if no run could be had
+ */
+static void *slab_alloc(size_t cls) {
+    // The heap must exist first: initializing it later would drop the slabs
+    if (heap->heap_start == NULL && !mm_init()) {
+        return NULL;
+    }
+
+    slab_run_t *run = slab_partial[cls];
+    if (run == NULL) {
+        run = slab_new_run(cls);
+        if (run == NULL) {
+            return NULL;
+        }
+    }
+
+    size_t i = 0;
+    while (run->free_map[i] == 0) {
+        i++;
+    }
+    size_t slot = i * 64 + __builtin_ctzl(run->free_map[i]);
+    run->free_map[i] &= run->free_map[i] - 1;
+    if (--run->num_free == 0) {
+        slab_unlink(run);
+    }
+    slab_bytes += run->slot_size;
+    return (char *)run + sizeof(slab_run_t) + slot * run->slot_size;
+}
+
+/**
+ * @brief Checks, under MM_HARDEN, that a pointer into the slab region being
+ *        freed is the start of a slot of a carved run.
+ * @param[in] bp A pointer for which in_slab is true
+ */
+static void harden_slot(void *bp) {
+    if (!hardened) {
+        return;
+    }
+    slab_run_t *run = slab_run_of(bp);
+    size_t offset = (size_t)((char *)bp - (char *)run);
+    if (run->slot_size == 0 || offset < sizeof(slab_run_t) ||
+        (offset - sizeof(slab_run_t)) % run->slot_size != 0 ||
+        (offset - sizeof(slab_run_t)) / run->slot_size >= run->num_slots) {
+        harden_fail("invalid free", bp);
+    }
+}
+
+/**
+ * @brief Frees a slot returned by slab_alloc.
+ * @param[in] bp The slot
+ */
+static void slab_free(void *bp) {
+    slab_run_t *run = slab_run_of(bp);
+    size_t slot = ((char *)bp - (char *)run - sizeof(slab_run_t)) /
+                  run->slot_size;
+    word_t bit = (word_t)1 << (slot % 64);
+
+    if (hardened && (run->free_map[slot / 64] & bit) != 0) {
+        harden_fail("double free", bp);
+    }
+    dbg_assert((run->free_map[slot / 64] & bit) == 0);
+    run->free_map[slot / 64] |= bit;
+    slab_bytes -= run->slot_size;
+    if (run->num_free++ == 0) {
+        slab_link(run);
+    }
+    if (run->num_free == run->num_slots &&
+        (run->next != NULL || run->prev != NULL)) {
+        slab_unlink(run);
+        run->next = slab_empty;
+        slab_empty = run;
+    }
+}
+
+/**
+ * @brief Unmaps the slab region, for mm_init starting over.
+ */
+static void slab_release_all(void) {
+    if (slab_base != NULL) {
+        munmap(slab_base, SLAB_REGION);
+    }
+    __atomic_store_n(&slab_base, NULL, __ATOMIC_RELAXED);
+    slab_brk = NULL;
+    for (size_t i = 0; i < SLAB_CLASSES; i++) {
+        slab_partial[i] = NULL;
+    }
+    slab_empty = NULL;
+    slab_runs = 0;
+    slab_bytes = 0;
+}
+
+/**
+ * @brief Checks every slab run and the lists they are on.
+ * @return True if the slabs are consistent
+ */
+static bool check_slabs(void) {
+    size_t with_free = 0;
+    size_t bytes = 0;
+
+    for (char *p = slab_base; p != NULL && p < slab_brk; p += SLAB_RUN) {
+        slab_run_t *run = (slab_run_t *)p;
+        if (run->cls >= SLAB_CLASSES ||
+            run->slot_size != (run->cls + 1) * dsize ||
+            run->num_slots != (SLAB_RUN - sizeof(slab_run_t)) / run->slot_size) {
+            dbg_printf("slab run header is wrong\n");
+            return false;
+        }
+        size_t free_slots = 0;
+        for (size_t i = 0; i < SLAB_RUN / 16 / 64; i++) {
+            free_slots += __builtin_popcountl(run->free_map[i]);
+        }
+        if (free_slots != run->num_free) {
+            dbg_printf("slab free map does not match its count\n");
+            return false;
+        }
+        if (run->num_free != 0) {
+            with_free++;
+        }
+        bytes += (size_t)(run->num_slots - run->num_free) * run->slot_size;
+    }
+
+    // Every run with a free slot is on exactly one list
+    size_t listed = 0;
+    for (slab_run_t *run = slab_empty; run != NULL; run = run->next) {
+        if (!in_slab(run) || run->num_free != run->num_slots) {
+            dbg_printf("slab_empty holds a run in use\n");
+            return false;
+        }
+        listed++;
+    }
+    for (size_t i = 0; i < SLAB_CLASSES; i++) {
+        slab_run_t *prev = NULL;
+        for (slab_run_t *run = slab_partial[i]; run != NULL; run = run->next) {
+            if (!in_slab(run) || run->cls != i || run->num_free == 0 ||
+                run->prev != prev) {
+                dbg_printf("slab_partial[%zu] is not consistent\n", i);
+                return false;
+            }
+            prev = run;
+            listed++;
+        }
+    }
+
+    if (listed != with_free || bytes != slab_bytes ||
+        slab_runs != (size_t)(slab_brk - slab_base) / SLAB_RUN) {
+        dbg_printf("slab counters do not match the runs\n");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ *                        LARGE OBJECTS
+ * ---------------------------------------------------------------------------
+ *
+ * Requests of mmap_threshold bytes or more get a mapping of their own
+ * instead of being carved from the heap, so that freeing them hands the
+ * memory straight back to the OS rather than leaving a hole (or a high
+ * break) behind. The mmap/munmap calls run outside the heap lock; only the
+ * chunk list is protected by it.
+ */
+
+/**
+ * @brief Returns the chunk that holds an mmapped block.
+ */
+static mmap_chunk_t *block_to_chunk(block_t *block) {
+    dbg_requires(is_mmapped(block));
+    return (mmap_chunk_t *)((char *)block - offsetof(mmap_chunk_t, block));
+}
+
+/**
+ * @brief Returns the mapping length needed for a block of `asize` bytes.
+ */
+static size_t mmap_length(size_t asize) {
+    return round_up(asize - wsize + mmap_overhead, mem_pagesize());
+}
+
+/**
+ * @brief Writes the header of a chunk's block for a mapping of `length`.
+ *
+ * The block size excludes the chunk bookkeeping and is kept a multiple of
+ * dsize, so get_payload_size is at most 8 bytes short of the mapping.
+ */
+static void write_mmap_header(mmap_chunk_t *chunk, size_t length) {
+    chunk->length = length;
+    header_store(&chunk->block,
+                 pack(length - mmap_overhead, true, true, false) | mmap_mask);
+}
+
+/**
+ * @brief Links a chunk at the head of the chunk list. Needs the heap lock.
+ */
+static void mmap_link(mmap_chunk_t *chunk) {
+    mmap_count++;
+    mmap_bytes += chunk->length;
+    chunk->prev = NULL;
+    chunk->next = mmap_chunks;
+    if (mmap_chunks != NULL) {
+        mmap_chunks->prev = chunk;
+    }
+    mmap_chunks = chunk;
+}
+
+/**
+ * @brief Unlinks a chunk from the chunk list. Needs the heap lock.
+ */
+static void mmap_unlink(mmap_chunk_t *chunk) {
+    if (hardened &&
+        ((chunk->prev != NULL ? chunk->prev->next : mmap_chunks) != chunk ||
+         (chunk->next != NULL && chunk->next->prev != chunk))) {
+        harden_fail("corrupted mapping list", chunk);
+    }
+    mmap_count--;
+    mmap_bytes -= chunk->length;
+    if (chunk->prev != NULL) {
+        chunk->prev->next = chunk->next;
+    } else {
+        mmap_chunks = chunk->next;
+    }
+    if (chunk->next != NULL) {
+        chunk->next->prev = chunk->prev;
+    }
+}
+
+/**
+ * @brief Allocates a block of at least `asize` bytes in its own mapping.
+ * @param[in] asize The adjusted block size
+ * @return The allocated block, or NULL if the mapping failed
+ */
+static block_t *mmap_alloc(size_t asize) {
+    size_t length = mmap_length(asize);
+    void *base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    mmap_chunk_t *chunk = base;
+    write_mmap_header(chunk, length);
+
+    heap_lock();
+    mmap_link(chunk);
+    heap_unlock();
+    return &chunk->block;
+}
+
+/**
+ * @brief Unmaps an mmapped block.
+ * @param[in] block A block returned by mmap_alloc or mmap_resize
+ */
+static void mmap_free(block_t *block) {
+    mmap_chunk_t *chunk = block_to_chunk(block);
+
+    heap_lock();
+    mmap_unlink(chunk);
+    heap_unlock();
+    munmap(chunk, chunk->length);
+}
+
+/**
+ * @brief Resizes an mmapped block with mremap, moving it if needed.
+ * @param[in] block A block returned by mmap_alloc or mmap_resize
+ * @param[in] asize The adjusted size the block should have
+ * @return The resized block, or NULL if it could not be remapped, in which
+ *         case the block is left untouched
+ */
+static block_t *mmap_resize(block_t *block, size_t asize) {
+    mmap_chunk_t *chunk = block_to_chunk(block);
+    size_t length = mmap_length(asize);
+    if (length == chunk->length) {
+        return block;
+    }
+
+    // The chunk may move, so it stays off the list while it does
+    heap_lock();
+    mmap_unlink(chunk);
+    void *base = mremap(chunk, chunk->length, length, MREMAP_MAYMOVE);
+    if (base != MAP_FAILED) {
+        chunk = base;
+        write_mmap_header(chunk, length);
+    }
+    mmap_link(chunk);
+    heap_unlock();
+
+    return base == MAP_FAILED ? NULL : &chunk->block;
+}
+
+/**
+ * @brief Unmaps every chunk, for mm_init starting over.
+ */
+static void mmap_release_all(void) {
+    while (mmap_chunks != NULL) {
+        mmap_chunk_t *chunk = mmap_chunks;
+        mmap_chunks = chunk->next;
+        munmap(chunk, chunk->length);
+    }
+    mmap_count = 0;
+    mmap_bytes = 0;
+}
+
+/**
+ * @brief Checks the chunk list and every mmapped block on it.
+ * @return True if every chunk is consistent
+ */
+static bool check_mmap_chunks(void) {
+    mmap_chunk_t *prev = NULL;
+    for (mmap_chunk_t *chunk = mmap_chunks; chunk != NULL;
+         chunk = chunk->next) {
+        block_t *block = &chunk->block;
+        if (chunk->prev != prev) {
+            dbg_printf("mmap chunk list is not consistent\n");
+            return false;
+        }
+        if (!get_alloc(block) || !is_mmapped(block) ||
+            chunk->length % mem_pagesize() != 0 ||
+            get_size(block) != chunk->length - mmap_overhead ||
+            ((uintptr_t)block->payload) % dsize != 0) {
+            dbg_printf("mmap chunk header is wrong\n");
+            return false;
+        }
+        prev = chunk;
+    }
+    return true;
+}
+
+/* Defined with allocation sampling below */
+static size_t sample_rate;
+static void sample_restart(void);
+static void sample_reset_live(void);
+
+/**
+ * @brief Sets an allocator tunable; see enum mm_param in mm.h.
+ * @param[in] param The tunable to set
+ * @param[in] value Its new value
+ * @return False if `param` is unknown
+ */
+bool mm_mallopt(int param, size_t value) {
+    bool known = true;
+
+    heap_lock();
+    switch (param) {
+    case MM_MMAP_THRESHOLD:
+        mmap_threshold = value;
+        break;
+    case MM_TRIM_THRESHOLD:
+        trim_threshold = value;
+        break;
+    case MM_TOP_PAD:
+        top_pad = value;
+        break;
+    case MM_RELEASE_THRESHOLD:
+        release_threshold = value;
+        break;
+    case MM_CHUNKSIZE_MIN:
+        chunksize_min = round_up(max(value, dsize), dsize);
+        chunksize_max = max(chunksize_max, chunksize_min);
+        break;
+    case MM_CHUNKSIZE_MAX:
+        chunksize_max = round_up(max(value, dsize), dsize);
+        chunksize_min = min(chunksize_min, chunksize_max);
+        break;
+    case MM_SLAB_MAX:
+        slab_max = min(value, SLAB_CLASSES * dsize);
+        break;
+    case MM_QUICK_MAX:
+        quick_max = min(value, QUICK_BINS * dsize);
+        break;
+    case MM_QUICK_LIMIT:
+        quick_limit = value;
+        break;
+    case MM_CHECK_RATE:
+        check_rate = value;
+        break;
+    case MM_CHECK_FULL:
+        check_full = value;
+        break;
+    case MM_SAMPLE_RATE:
+        sample_rate = value;
+        sample_restart();
+        break;
+    default:
+        known = false;
+        break;
+    }
+    heap_unlock();
+    return known;
+}
+
+/******** The remaining content below are helper and debug routines ********/
+
+/* Defined with the large free block tree below */
+static block_t *class_first(size_t index);
+static block_t *class_next(block_t *block);
+
+/* Defined with the heap checker below */
+static bool check_links(block_t *block);
+static bool check_touched(block_t *block);
+
+/**
  * @brief this function prints the contents of the heap 
 */
 
 static void print_heap(){
 
     //print size, allocation, and loc of prologue and epilogue 
-    block_t *pro = (block_t *) ((char*) mem_heap_lo());
+    block_t *pro = (block_t *) ((char*) heap_lo());
     printf("\n************************\n");
     printf("\033[0;34m");
     printf("Prologue %lu\n", pro->header);
@@ -514,7 +1710,7 @@ static void print_heap(){
     //print header, allocation status, next and prev pointer, and payload
    block_t* block; 
     
-    for (block = find_next(heap_start); get_size(block) > 0; block = find_next(block)){
+    for (block = find_next(heap->heap_start); get_size(block) > 0; block = find_next(block)){
         printf("the header is %lu \n", block->header);
         if(get_alloc(block) == true){
             printf("Allocation status: allocated\n");
@@ -523,17 +1719,15 @@ static void print_heap(){
         else{
             
             printf("Allocation status: free\n");
-            if(get_size(block) > dsize){
-                if(block->prev_list != NULL){
-                    printf("Prev pointer is %lu\n", get_size(block->prev_list));
-                }
-                else{
-                    printf("Prev pointer is NULL\n");
-                }
+            if(list_prev(block) != NULL){
+                printf("Prev pointer is %lu\n", get_size(list_prev(block)));
+            }
+            else{
+                printf("Prev pointer is NULL\n");
             }
 
-                if(block->next_list != NULL){
-                    printf("Next pointer is %lu\n", block->next_list->header);
+                if(list_next(block) != NULL){
+                    printf("Next pointer is %lu\n", list_next(block)->header);
                 }
                 else{
                     printf("Next pointer is NULL\n");
@@ -564,25 +1758,26 @@ static void print_heap(){
         //print each seg_list
 
         for(size_t i = 0; i< NUM_CLASS; i++){
-            block_t* current = seg_list[i];
+            block_t* current = class_first(i);
             printf("\n seg_list at index %zu", i);
             printf("\n+++++++++++++++++\n");
             while(current != NULL){
                 printf("the header is %lu \n", get_size(current));
-                if(current->next_list != NULL){
-                    printf("Next pointer is %lu\n", get_size(current->next_list));
+                if(class_next(current) != NULL){
+                    printf("Next pointer is %lu\n", get_size(class_next(current)));
                 }
                 else{
                     printf("Next pointer is NULL\n");
                 }
-                if(i != 0){
-                if(current->prev_list != NULL){
-                    printf("Prev pointer is %lu\n", get_size(current->prev_list));
+                if(i == tree_class){ //tree blocks have no prev pointer
+                    printf("Tree node, %s\n", current->tree_red ? "red" : "black");
+                }
+                else if(list_prev(current) != NULL){
+                    printf("Prev pointer is %lu\n", get_size(list_prev(current)));
                 }
                 else{
                     printf("Prev pointer is NULL\n");
                 }
-                }
 
                 if(get_prev_alloc(current) == true ){
                     printf("Previous block is allocated\n");
@@ -599,116 +1794,502 @@ static void print_heap(){
                 }
 
             
-                current = current->next_list;
+                current = class_next(current);
                 printf("+++++++++++++++++\n");
             }
         }
 
         printf("--------------------\n");
-    block_t *epi = (block_t *)((char *) mem_heap_hi() -7);
+    block_t *epi = (block_t *)((char *) heap_hi() -7);
     printf("\033[0;34m");
     printf("Epilogue %lu\n", epi->header);
     printf("\033[0m");
+
+    //mmapped blocks live outside the heap, so they get their own section
+    printf("\n mmapped blocks");
+    printf("\n+++++++++++++++++\n");
+    for(mmap_chunk_t *chunk = mmap_chunks; chunk != NULL; chunk = chunk->next){
+        printf("the header is %lu \n", chunk->block.header);
+        printf("Mapping at %p, %zu bytes\n", (void *)chunk, chunk->length);
+        printf("+++++++++++++++++\n");
+    }
+
+    //so do the slab runs
+    printf("\n slab runs");
+    printf("\n+++++++++++++++++\n");
+    for(char *p = slab_base; p != NULL && p < slab_brk; p += SLAB_RUN){
+        slab_run_t *run = (slab_run_t *)p;
+        printf("Run at %p, slot size %u, %u of %u slots free\n", (void *)run,
+               run->slot_size, run->num_free, run->num_slots);
+    }
     printf("************************\n");
     //printf("--------------------\n");
 }
 
 /**
- * @brief this calculates the log_2 index of the size of the block
- * @return returns the index 
-*/
-static size_t log_2(size_t num){
-    long res = -1;
-    while( num > 0){
-        num >>= 1;
-        res++;
+ * @brief Returns the seg_list class that a block of `size` bytes belongs to.
+ *
+ * Small sizes map linearly; above that the first level is the position of
+ * the highest set bit (one count-leading-zeros instruction) and the second
+ * level is the next SUB_BITS bits below it.
+ *
+ * @param[in] size A block size, a multiple of dsize
+ * @return The class index, between 0 and NUM_CLASS - 1
+ */
+static size_t size_class(size_t size) {
+    dbg_requires(size >= dsize && size % dsize == 0);
+
+    if (size < ((size_t)1 << (SUB_BITS + 4))) {
+        return size / dsize - 1;
     }
-    return (size_t) res;
 
+    size_t fl = (sizeof(size_t) * 8 - 1) - (size_t)__builtin_clzl(size);
+    if (fl >= LARGE_LOG) {
+        return NUM_CLASS - 1;
+    }
+    size_t sl = (size >> (fl - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+    return ((1 << SUB_BITS) - 1) + ((fl - SUB_BITS - 4) << SUB_BITS) + sl;
 }
+
+/*
+ * ---------------------------------------------------------------------------
+ *                        LARGE FREE BLOCK TREE
+ * ---------------------------------------------------------------------------
+ *
+ * Free blocks of the last class (2^LARGE_LOG bytes or more) are not kept
+ * on a list but in a red-black tree rooted at seg_list[NUM_CLASS - 1],
+ * ordered by size and then by address, so find_fit gets a true best fit
+ * (the lowest-addressed among equals) in O(log n). The nodes live in the
+ * free blocks' payloads. Everything here needs the heap lock.
+ */
+
 /**
- * @brief this function adds the block to the seg list 
-*/
+ * @brief Returns whether `a` sorts before `b`: smaller, or as large and at a
+ *        lower address.
+ */
+static bool tree_less(block_t *a, block_t *b) {
+    size_t size_a = get_size(a);
+    size_t size_b = get_size(b);
+    return size_a < size_b || (size_a == size_b && a < b);
+}
 
-static void add(block_t *block)
- {
-  dbg_requires(block != NULL); 
-    size_t size = get_size(block);
-    
-    if(size <= dsize){ // insert into mini_free list fo rmini_blocks
-        size_t in = log_2((size-1));
-        if(seg_list[in] == NULL){ //either the list is empty 
-            seg_list[in] = block;
-            seg_list[in]->next_list = NULL;
-        }
-        else{
-            block->next_list = seg_list[in]; //list is not empty
-            seg_list[in] = block;
-        }
+/**
+ * @brief Makes `child` take the place of `old` under `parent` (or as the
+ *        root, if `parent` is NULL).
+ */
+static void tree_replace_child(block_t *parent, block_t *old, block_t *child) {
+    if (parent == NULL) {
+        heap->seg_list[tree_class] = child;
+    } else if (parent->tree_left == old) {
+        parent->tree_left = child;
+    } else {
+        parent->tree_right = child;
     }
-    else{ //insert into seg list 
-        size_t index = log_2((size-1));
-        if(index > NUM_CLASS-1){
-            index = NUM_CLASS-1; 
-        }        
-        
-        if(seg_list[index] != NULL){
-      
-            block->next_list = seg_list[index];
-            seg_list[index]->prev_list = block;
-            seg_list[index] = block;
-            seg_list[index]->prev_list = NULL;
-        }
-        else{
-            seg_list[index] = block;
-            seg_list[index]->next_list = NULL;
-            seg_list[index]->prev_list = NULL;
-        }
+}
 
+static void tree_rotate_left(block_t *node) {
+    block_t *right = node->tree_right;
+    node->tree_right = right->tree_left;
+    if (right->tree_left != NULL) {
+        right->tree_left->tree_parent = node;
     }
+    right->tree_parent = node->tree_parent;
+    tree_replace_child(node->tree_parent, node, right);
+    right->tree_left = node;
+    node->tree_parent = right;
+}
 
+static void tree_rotate_right(block_t *node) {
+    block_t *left = node->tree_left;
+    node->tree_left = left->tree_right;
+    if (left->tree_right != NULL) {
+        left->tree_right->tree_parent = node;
+    }
+    left->tree_parent = node->tree_parent;
+    tree_replace_child(node->tree_parent, node, left);
+    left->tree_right = node;
+    node->tree_parent = left;
 }
 
-/**
- * @brief deletes node from double linked list 
-*/
-static void delete(block_t *block) {
+static bool tree_is_red(block_t *node) {
+    return node != NULL && node->tree_red;
+}
 
-    size_t size = get_size(block);
-    if(size == dsize){
-        size_t in = log_2((size-1));
-        if(seg_list[in] == block){ //if head of mini list is block to delete
-            seg_list[in] = seg_list[in]->next_list;
-            block->next_list = NULL;
-        }
-        else{ //the block is somewhere in the list 
-            block_t* cur = seg_list[in];
-            while(cur->next_list!= block){
-                cur = cur->next_list;
+/**
+ * @brief Inserts a free block into the tree and rebalances it.
+ * @param[in] block A free block of the last class
+ */
+static void tree_insert(block_t *block) {
+    block_t *parent = NULL;
+    block_t **link = &heap->seg_list[tree_class];
+    while (*link != NULL) {
+        parent = *link;
+        link = tree_less(block, parent) ? &parent->tree_left
+                                        : &parent->tree_right;
+    }
+    block->tree_left = NULL;
+    block->tree_right = NULL;
+    block->tree_parent = parent;
+    block->tree_red = true;
+    *link = block;
+
+    // A red node with a red parent: recolour, or rotate once or twice
+    while (tree_is_red(block->tree_parent)) {
+        parent = block->tree_parent;
+        block_t *grand = parent->tree_parent;
+        if (parent == grand->tree_left) {
+            block_t *uncle = grand->tree_right;
+            if (tree_is_red(uncle)) {
+                parent->tree_red = false;
+                uncle->tree_red = false;
+                grand->tree_red = true;
+                block = grand;
+                continue;
+            }
+            if (block == parent->tree_right) {
+                block = parent;
+                tree_rotate_left(block);
+                parent = block->tree_parent;
+            }
+            parent->tree_red = false;
+            grand->tree_red = true;
+            tree_rotate_right(grand);
+        } else {
+            block_t *uncle = grand->tree_left;
+            if (tree_is_red(uncle)) {
+                parent->tree_red = false;
+                uncle->tree_red = false;
+                grand->tree_red = true;
+                block = grand;
+                continue;
             }
-            cur->next_list = block->next_list;
-            block->next_list = NULL;
+            if (block == parent->tree_left) {
+                block = parent;
+                tree_rotate_right(block);
+                parent = block->tree_parent;
+            }
+            parent->tree_red = false;
+            grand->tree_red = true;
+            tree_rotate_left(grand);
         }
     }
-    else
-    { 
-        size_t index = log_2(size-1);
-        if(index > NUM_CLASS-1){
-            index = NUM_CLASS-1; 
-        }
-
-        if(seg_list[index] == block){
-            
-            seg_list[index] = block->next_list;
-            if(block->next_list != NULL){
+    heap->seg_list[tree_class]->tree_red = false;
+}
 
-                block->next_list->prev_list = NULL;
+/**
+ * @brief Restores the red-black properties after a black node was removed
+ *        from above `node` (which may be NULL), a child of `parent`.
+ */
+static void tree_remove_fixup(block_t *node, block_t *parent) {
+    while (node != heap->seg_list[tree_class] && !tree_is_red(node)) {
+        if (node == parent->tree_left) {
+            block_t *sibling = parent->tree_right;
+            if (sibling->tree_red) {
+                sibling->tree_red = false;
+                parent->tree_red = true;
+                tree_rotate_left(parent);
+                sibling = parent->tree_right;
             }
-            return;
-        }
-        
-
-        if(block->prev_list!= NULL && block->next_list == NULL){
+            if (!tree_is_red(sibling->tree_left) &&
+                !tree_is_red(sibling->tree_right)) {
+                sibling->tree_red = true;
+                node = parent;
+                parent = node->tree_parent;
+                continue;
+            }
+            if (!tree_is_red(sibling->tree_right)) {
+                sibling->tree_left->tree_red = false;
+                sibling->tree_red = true;
+                tree_rotate_right(sibling);
+                sibling = parent->tree_right;
+            }
+            sibling->tree_red = parent->tree_red;
+            parent->tree_red = false;
+            sibling->tree_right->tree_red = false;
+            tree_rotate_left(parent);
+        } else {
+            block_t *sibling = parent->tree_left;
+            if (sibling->tree_red) {
+                sibling->tree_red = false;
+                parent->tree_red = true;
+                tree_rotate_right(parent);
+                sibling = parent->tree_left;
+            }
+            if (!tree_is_red(sibling->tree_left) &&
+                !tree_is_red(sibling->tree_right)) {
+                sibling->tree_red = true;
+                node = parent;
+                parent = node->tree_parent;
+                continue;
+            }
+            if (!tree_is_red(sibling->tree_left)) {
+                sibling->tree_right->tree_red = false;
+                sibling->tree_red = true;
+                tree_rotate_left(sibling);
+                sibling = parent->tree_left;
+            }
+            sibling->tree_red = parent->tree_red;
+            parent->tree_red = false;
+            sibling->tree_left->tree_red = false;
+            tree_rotate_right(parent);
+        }
+        node = heap->seg_list[tree_class];
+    }
+    if (node != NULL) {
+        node->tree_red = false;
+    }
+}
+
+/**
+ * @brief Removes a block from the tree and rebalances it.
+ * @param[in] block A block in the tree
+ */
+static void tree_remove(block_t *block) {
+    block_t *child;
+    block_t *parent;
+    bool removed_red;
+
+    if (block->tree_left == NULL || block->tree_right == NULL) {
+        // At most one child, which moves up into the block's place
+        child = block->tree_left != NULL ? block->tree_left : block->tree_right;
+        parent = block->tree_parent;
+        removed_red = block->tree_red;
+        tree_replace_child(parent, block, child);
+        if (child != NULL) {
+            child->tree_parent = parent;
+        }
+    } else {
+        // The successor has no left child; it moves into the block's place
+        block_t *next = block->tree_right;
+        while (next->tree_left != NULL) {
+            next = next->tree_left;
+        }
+        child = next->tree_right;
+        removed_red = next->tree_red;
+        if (next->tree_parent == block) {
+            parent = next;
+        } else {
+            parent = next->tree_parent;
+            parent->tree_left = child;
+            if (child != NULL) {
+                child->tree_parent = parent;
+            }
+            next->tree_right = block->tree_right;
+            next->tree_right->tree_parent = next;
+        }
+        tree_replace_child(block->tree_parent, block, next);
+        next->tree_parent = block->tree_parent;
+        next->tree_left = block->tree_left;
+        next->tree_left->tree_parent = next;
+        next->tree_red = block->tree_red;
+    }
+
+    if (!removed_red) {
+        tree_remove_fixup(child, parent);
+    }
+}
+
+/**
+ * @brief Returns the smallest free block in the tree of at least `asize`
+ *        bytes (the lowest-addressed one if several are as small).
+ * @param[in] asize The adjusted size being allocated
+ * @return The best fit, or NULL if no block in the tree is large enough
+ */
+static block_t *tree_best_fit(size_t asize) {
+    block_t *best = NULL;
+    block_t *node = heap->seg_list[tree_class];
+    while (node != NULL) {
+        if (get_size(node) >= asize) {
+            best = node;
+            node = safe_link(node, node->tree_left);
+        } else {
+            node = safe_link(node, node->tree_right);
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Returns the block after `block` in tree order, or NULL.
+ */
+static block_t *tree_next(block_t *block) {
+    if (block->tree_right != NULL) {
+        block = block->tree_right;
+        while (block->tree_left != NULL) {
+            block = block->tree_left;
+        }
+        return block;
+    }
+    while (block->tree_parent != NULL && block == block->tree_parent->tree_right) {
+        block = block->tree_parent;
+    }
+    return block->tree_parent;
+}
+
+/**
+ * @brief Checks the parent links and red-black properties of a subtree.
+ * @param[in] node The root of the subtree, or NULL
+ * @param[in] parent The node's parent
+ * @return The number of black nodes on every path down from `node`, or -1
+ *         if the subtree is broken
+ */
+static int check_tree(block_t *node, block_t *parent) {
+    if (node == NULL) {
+        return 0;
+    }
+    if (node->tree_parent != parent ||
+        (node->tree_red && (parent == NULL || parent->tree_red))) {
+        dbg_printf("tree node is not consistent\n");
+        return -1;
+    }
+    int left = check_tree(node->tree_left, node);
+    int right = check_tree(node->tree_right, node);
+    if (left < 0 || left != right) {
+        dbg_printf("tree is not balanced\n");
+        return -1;
+    }
+    return left + !node->tree_red;
+}
+
+/**
+ * @brief Returns the first free block of class `index` (the smallest one,
+ *        for the tree), or NULL if the class is empty.
+ */
+static block_t *class_first(size_t index) {
+    block_t *block = heap->seg_list[index];
+    if (index == tree_class && block != NULL) {
+        while (block->tree_left != NULL) {
+            block = block->tree_left;
+        }
+    }
+    return block;
+}
+
+/**
+ * @brief Returns the free block after `block` in its class, or NULL.
+ */
+static block_t *class_next(block_t *block) {
+    if (size_class(get_size(block)) == tree_class) {
+        return tree_next(block);
+    }
+    return list_next(block);
+}
+
+/**
+ * @brief this function adds the block to the seg list 
+*/
+
+static void add(block_t *block)
+ {
+  dbg_requires(block != NULL); 
+    size_t size = get_size(block);
+    
+    if(size <= dsize){ // insert into mini_free list fo rmini_blocks
+        size_t in = size_class(size);
+        block_t *head = heap->seg_list[in];
+        block->mini_next = mini_link(block, head);
+        block->mini_prev = 0;
+        if(head != NULL){ //list is not empty
+            head->mini_prev = mini_link(head, block);
+        }
+        heap->seg_list[in] = block;
+        heap->class_bitmap |= (word_t)1 << in;
+        heap->class_blocks[in]++;
+        heap->class_bytes[in] += size;
+        heap->free_bytes += size;
+    }
+    else{ //insert into seg list 
+        size_t index = size_class(size);
+        heap->class_bitmap |= (word_t)1 << index;
+        heap->class_blocks[index]++;
+        heap->class_bytes[index] += size;
+        heap->free_bytes += size;
+        
+        if(index == tree_class){ //large blocks go in the tree
+            tree_insert(block);
+        }
+        else if(heap->seg_list[index] != NULL){
+      
+            block->next_list = heap->seg_list[index];
+            heap->seg_list[index]->prev_list = block;
+            heap->seg_list[index] = block;
+            heap->seg_list[index]->prev_list = NULL;
+        }
+        else{
+            heap->seg_list[index] = block;
+            heap->seg_list[index]->next_list = NULL;
+            heap->seg_list[index]->prev_list = NULL;
+        }
+
+    }
+
+}
+
+/**
+ * @brief deletes node from double linked list 
+*/
+static void delete(block_t *block) {
+    // Safe unlinking: a forged header or link must not steer the writes
+    // below. The footer's prev bits may lag behind the header's.
+    if (hardened &&
+        (!tag_ok(block->header) ||
+         (get_size(block) > dsize &&
+          ((*header_to_footer(block) ^ block->header) &
+           ~(prev_mask | mini_prev_mask)) != 0) ||
+         !check_links(block))) {
+        harden_fail("corrupted free block", block);
+    }
+
+    size_t size = get_size(block);
+    heap->class_blocks[size_class(size)]--;
+    heap->class_bytes[size_class(size)] -= size;
+    heap->free_bytes -= size;
+    if(size == dsize){
+        size_t in = size_class(size);
+        block_t *next = mini_follow(block, block->mini_next);
+        block_t *prev = mini_follow(block, block->mini_prev);
+        if(next != NULL){
+            next->mini_prev = mini_link(next, prev);
+        }
+        if(prev != NULL){ //the block is somewhere in the list 
+            prev->mini_next = mini_link(prev, next);
+        }
+        else{ //if head of mini list is block to delete
+            heap->seg_list[in] = next;
+            if(next == NULL){
+                heap->class_bitmap &= ~((word_t)1 << in);
+            }
+        }
+        block->mini_next = 0;
+        block->mini_prev = 0;
+    }
+    else
+    { 
+        size_t index = size_class(size);
+
+        if(index == tree_class){
+            tree_remove(block);
+            if(heap->seg_list[index] == NULL){
+                heap->class_bitmap &= ~((word_t)1 << index);
+            }
+            return;
+        }
+
+        if(heap->seg_list[index] == block){
+            
+            heap->seg_list[index] = block->next_list;
+            if(block->next_list != NULL){
+
+                block->next_list->prev_list = NULL;
+            }
+            else{
+                heap->class_bitmap &= ~((word_t)1 << index);
+            }
+            return;
+        }
+        
+
+        if(block->prev_list!= NULL && block->next_list == NULL){
             block->prev_list->next_list = NULL;
             block->prev_list = NULL;
             return;
@@ -726,6 +2307,16 @@ static void delete(block_t *block) {
     
 
 
+/**
+ * @brief Clears the words that stop two merged zeroed blocks from being
+ *        zero as a whole: the left block's footer, and the right block's
+ *        header and list links.
+ * @param[in] right The right-hand block of the merge, no longer on any list
+ */
+static void clear_seam(block_t *right) {
+    memset((char *)right - wsize, 0, wsize + sizeof(block_t));
+}
+
 /**
  * @brief
  *
@@ -760,11 +2351,13 @@ static block_t *coalesce_block(block_t *block) {
     block_t* next = find_next(block);
     bool prev_alloc = get_prev_alloc(block);
     block_t* prev;
+    // The merged block is zeroed only if every part of it is
+    bool zeroed = get_zeroed(block);
     
     //case 1: both prev and next are allocated
     if(prev_alloc == true && get_alloc(next) == true){ //find prev alloc on current block
         add(block);
-        dbg_ensures(mm_checkheap(__LINE__));
+        dbg_ensures(check_touched(block));
         return block;
     }
 
@@ -777,21 +2370,30 @@ static block_t *coalesce_block(block_t *block) {
             prev = find_prev(block); 
         }
 
+        zeroed = zeroed && get_zeroed(prev);
         delete(prev);
 
         write_block(prev,get_size(prev)+ get_size(block),false,get_prev_alloc(prev),get_mini_prev(prev));
+        if (zeroed) {
+            clear_seam(block);
+            set_zeroed(prev);
+        }
         add(prev);
-        dbg_ensures(mm_checkheap(__LINE__));
+        dbg_ensures(check_touched(prev));
         return prev;
     }
     //case 2: only next is free
     if(prev_alloc == true  && get_alloc(next) == false){
+        zeroed = zeroed && get_zeroed(next);
          delete(next);
         write_block(block,get_size(next)+ get_size(block),false, get_prev_alloc(block), get_mini_prev(block));
-        
+        if (zeroed) {
+            clear_seam(next);
+            set_zeroed(block);
+        }
         
         add(block);
-         dbg_ensures(mm_checkheap(__LINE__));
+         dbg_ensures(check_touched(block));
          return block;
     }
     
@@ -805,13 +2407,19 @@ static block_t *coalesce_block(block_t *block) {
         } 
 
     
+        zeroed = zeroed && get_zeroed(prev) && get_zeroed(next);
         delete(next);
 
         delete(prev);
          write_block(prev,get_size(next)+ get_size(block) + get_size(prev),false, get_prev_alloc(prev), get_mini_prev(prev));
+         if (zeroed) {
+             clear_seam(block);
+             clear_seam(next);
+             set_zeroed(prev);
+         }
          
          add(prev);
-         dbg_ensures(mm_checkheap(__LINE__));
+         dbg_ensures(check_touched(prev));
          return prev;
     }
 dbg_ensures(mm_checkheap(__LINE__));
@@ -840,9 +2448,21 @@ static block_t *extend_heap(size_t size) {
 
     // Allocate an even number of words to maintain alignment
     size = round_up(size, dsize);
-    if ((bp = mem_sbrk((intptr_t)size)) == (void *)-1) {
+    if ((bp = heap_sbrk((intptr_t)size)) == (void *)-1) {
         return NULL;
     }
+    heap->extend_count++;
+
+    // Fresh memory reads zero; a dirty gap of up to a page before zero_brk
+    // (left by trim_tail) is cheap enough to clear
+    char *end = (char *)bp + size;
+    bool zeroed = heap->zero_brk <= (char *)bp + mem_pagesize();
+    if (zeroed && heap->zero_brk > (char *)bp) {
+        memset(bp, 0, min((size_t)(heap->zero_brk - (char *)bp), size));
+    }
+    if (heap->zero_brk < end) {
+        heap->zero_brk = end;
+    }
 
     /*
      * TODO: delete or replace this comment once you've thought about it.
@@ -854,6 +2474,10 @@ static block_t *extend_heap(size_t size) {
     // Initialize free block header/footer
     block_t *block = payload_to_header(bp);
     write_block(block, size, false, get_prev_alloc(block), get_mini_prev(block));
+    if (zeroed) {
+        set_zeroed(block);
+    }
+    zeroed = get_zeroed(block);
 
     // Create new epilogue header
     block_t *block_next = find_next(block);
@@ -865,177 +2489,715 @@ static block_t *extend_heap(size_t size) {
     }
 
     // Coalesce in case the previous block was free
-    block = coalesce_block(block);
+    block_t *merged = coalesce_block(block);
+
+    // A dirty free block in front (such as the pad trim_tail leaves) is
+    // cleared when it is no larger than the extension, so that growing the
+    // heap always makes a zeroed block
+    size_t front = (size_t)((char *)block - (char *)merged);
+    if (zeroed && front != 0 && front <= size && !get_zeroed(merged)) {
+        char *from = (char *)merged + sizeof(block_t);
+        memset(from, 0, (size_t)((char *)block + sizeof(block_t) - from));
+        set_zeroed(merged);
+    }
+
+    return merged;
+}
+
+
+
+/**
+ * @brief Returns the last block of the heap if it is free.
+ * @return The free block in front of the epilogue, or NULL if that block
+ *         is allocated or the heap is empty
+ */
+static block_t *last_free_block(void) {
+    block_t *epi = (block_t *)((char *)heap_hi() - 7);
+    if (get_prev_alloc(epi) || epi == heap->heap_start) {
+        return NULL;
+    }
+    if (get_mini_prev(epi)) {
+        return find_prev_mini(epi);
+    }
+    return footer_to_header(find_prev_footer(epi));
+}
+
+/**
+ * @brief Extends the heap so that a free block of `asize` bytes exists.
+ *
+ * A free block at the end of the heap already covers part of the request,
+ * so only the rest is requested (but at least chunksize bytes). chunksize
+ * then doubles or halves depending on how much was allocated since the
+ * previous extension.
+ *
+ * @param[in] asize The adjusted size of the block that did not fit
+ * @return A free block of at least `asize` bytes, or NULL if the heap
+ *         could not be extended
+ */
+static block_t *grow_heap(size_t asize) {
+    block_t *last = last_free_block();
+    size_t tail = 0;
+    if (last != NULL) {
+        tail = get_size(last);
+        if (tail >= asize) {
+            // find_fit gave up on its bounded probe before reaching it
+            return last;
+        }
+    }
+
+    block_t *block = extend_heap(max(asize - tail, heap->chunksize));
+    if (block == NULL) {
+        return NULL;
+    }
 
+    size_t limit = max(chunksize_min, min(chunksize_max, heap_size() / 8));
+    if (heap->alloc_since_extend <= 2 * heap->chunksize) {
+        heap->chunksize = min(heap->chunksize * 2, limit);
+    } else {
+        heap->chunksize = heap->chunksize / 2;
+    }
+    heap->chunksize = max(round_up(heap->chunksize, dsize), chunksize_min);
+    heap->alloc_since_extend = 0;
     return block;
 }
 
+/**
+ * @brief Returns the whole pages inside a free block to the OS.
+ *
+ * Uses MADV_DONTNEED on the pages strictly between the block's list links
+ * and its footer, so the block stays intact and the pages read back as
+ * zero when they are touched again. (MADV_FREE would be cheaper but leaves
+ * their contents undefined.) The bytes around those pages are cleared too,
+ * so that the block is zeroed as a whole.
+ *
+ * @param[in] block A free block
+ * @return The number of bytes released
+ */
+static size_t release_pages(block_t *block) {
+    dbg_requires(!get_alloc(block));
+
+    uintptr_t page = mem_pagesize();
+    uintptr_t start = round_up((uintptr_t)block + sizeof(block_t), page);
+    uintptr_t end = ((uintptr_t)header_to_footer(block) / page) * page;
+    if (end <= start) {
+        return 0;
+    }
+    if (madvise((void *)start, end - start, MADV_DONTNEED) != 0) {
+        return 0;
+    }
+    if (!get_zeroed(block)) {
+        uintptr_t links = (uintptr_t)block + sizeof(block_t);
+        uintptr_t footer = (uintptr_t)header_to_footer(block);
+        memset((void *)links, 0, start - links);
+        memset((void *)end, 0, footer - end);
+        set_zeroed(block);
+    }
+    return end - start;
+}
+
+/**
+ * @brief Shrinks the heap when its last block is free.
+ *
+ * Moves the break down so that at most `pad` bytes of the free tail block
+ * remain, and drops the pages given up. If the break cannot move down (the
+ * course's memlib refuses negative increments), the heap is left as is.
+ *
+ * @param[in] pad Bytes of free space to keep at the end of the heap
+ * @return The number of bytes the heap shrank by
+ */
+static size_t trim_tail(size_t pad) {
+    block_t *last = last_free_block();
+    if (last == NULL) {
+        return 0;
+    }
+
+    size_t size = get_size(last);
+    size_t keep = round_up(pad, dsize);
+    if (size <= keep) {
+        return 0;
+    }
+    size_t release = size - keep;
+    bool zeroed = get_zeroed(last);
+
+    delete(last);
+    if (heap_sbrk(-(intptr_t)release) == (void *)-1) {
+        add(last);
+        return 0;
+    }
+
+    if (keep == 0) {
+        // The block before is allocated, so the epilogue moves onto it
+        header_store(last, pack(0, true, true, get_mini_prev(last)));
+    } else {
+        write_epilogue((block_t *)((char *)last + keep), keep == dsize);
+        write_block(last, keep, false, get_prev_alloc(last), get_mini_prev(last));
+        if (zeroed) {
+            set_zeroed(last);
+        }
+        add(last);
+    }
 
+    heap->chunksize = max(round_up(heap->chunksize / 2, dsize), chunksize_min);
+
+    // Pages past the new break are not part of the heap any more. They read
+    // zero from now on, and so does everything past the old break when
+    // nothing there was written since it was mapped.
+    uintptr_t page = mem_pagesize();
+    uintptr_t start = round_up((uintptr_t)heap_hi() + 1, page);
+    uintptr_t end = round_up((uintptr_t)heap_hi() + 1 + release, page);
+    if (start < end && madvise((void *)start, end - start, MADV_DONTNEED) == 0 &&
+        (uintptr_t)heap->zero_brk <= end) {
+        heap->zero_brk = (char *)start;
+    }
+    return release;
+}
 
 /**
- * @brief
+ * @brief Gives memory in a newly freed block back to the OS if it is big.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * A free block at the end of the heap of trim_threshold bytes or more is
+ * trimmed down to top_pad bytes; one elsewhere of release_threshold bytes
+ * or more has its whole pages released.
  *
- * @param[in] block
- * @param[in] asize
+ * @param[in] block A free block that was just coalesced
+ */
+static void release_free_block(block_t *block) {
+    size_t size = get_size(block);
+    if (trim_threshold != 0 && size >= trim_threshold &&
+        get_size(find_next(block)) == 0) {
+        trim_tail(top_pad);
+    } else if (release_threshold != 0 && size >= release_threshold) {
+        release_pages(block);
+    }
+}
+
+/**
+ * @brief Splits an allocated block so that it is exactly `asize` bytes.
+ *
+ * If the leftover space is large enough to hold a block, it is turned into
+ * a free block and coalesced with the block after it (which matters when
+ * realloc shrinks a block sitting in front of a free block). Otherwise the
+ * block is left whole.
+ *
+ * @param[in] block An allocated block that is not on any free list
+ * @param[in] asize The adjusted size the block must keep
+ * @param[in] zeroed Whether the space past `asize` is known to be zero
+ *                   (see get_zeroed), which the leftover block then keeps
+ * @pre asize <= get_size(block)
  */
-static void split_block(block_t *block, size_t asize) { // how does the free list change in this case
+static void split_block(block_t *block, size_t asize, bool zeroed) {
     dbg_requires(get_alloc(block));
-    /* TODO: Can you write a precondition about the value of asize? */
+    dbg_requires(asize <= get_size(block));
 
     size_t block_size = get_size(block);
 
     if ((block_size - asize) >= min_block_size) { 
         block_t *block_next; 
 
-        delete(block);
         write_block(block, asize, true, get_prev_alloc(block), get_mini_prev(block)) ;
 
         block_next = find_next(block); 
        
         write_block(block_next, block_size - asize, false, true, asize==dsize);
-        add(block_next);
-        
-    }
-    else{
-        delete(block);
+        if (zeroed) {
+            set_zeroed(block_next);
+        }
+        coalesce_block(block_next);
+        heap->split_count++;
     }
 
     dbg_ensures(get_alloc(block));
 }
 
 /**
- * @brief
+ * @brief Looks up to NUM_AHEAD blocks past a fitting block for a tighter fit.
+ * @param[in] block A free block of at least `asize` bytes
+ * @param[in] asize The adjusted size being allocated
+ * @return The smallest fitting block among those looked at
+ */
+static block_t *better_fit(block_t *block, size_t asize) {
+    dbg_requires(get_size(block) >= asize);
+
+    if (asize == get_size(block)) {
+        return block;
+    }
+
+    block_t* temp = block;
+    size_t num = NUM_AHEAD;
+    size_t temp_size = get_size(block);
+
+    block = safe_link(block, block->next_list);
+    while(num>0 && block !=NULL){
+        if(get_size(block) < temp_size && get_size(block) >= asize){
+            temp_size = get_size(block);
+            temp = block;
+        }
+        num = num - 1;
+        block = safe_link(block, block->next_list);
+    }
+    dbg_assert(block != temp);
+    dbg_assert(num ==0 || block == NULL);
+    return temp;
+}
+
+/**
+ * @brief Finds a free block of at least `asize` bytes.
  *
- * <What does this function do?>
- * <What are the function's arguments?>  
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * The request's own class is searched first, but only for NUM_PROBE
+ * blocks, since it also holds blocks that are too small. Every block in a
+ * higher class fits, so the next non-empty one is found with a single
+ * find-first-set on class_bitmap and its head (or a better fit among the
+ * NUM_AHEAD blocks after it) is returned. Large blocks come from the tree,
+ * which always gives the best fit.
  *
- * @param[in] asize
- * @return
+ * @param[in] asize The adjusted size being allocated
+ * @return A free block that fits, or NULL if there is none
  */
 static block_t *find_fit(size_t asize) {
 
     block_t *block;
    
     if(asize == dsize){
-        block = seg_list[0];
+        block = heap->seg_list[0];
         if(block != NULL ){
             return block;
         }
     }
-    //printf("Finding the block..\n");
 
-    size_t index = log_2((asize-1));
-    if(index > NUM_CLASS-1){
-        index = NUM_CLASS-1; 
-    }   
-    for(size_t i = index; i < NUM_CLASS; i++){
-        block = seg_list[i];
-        while(block!= NULL){
-            if (asize == get_size(block)) {
-                return block;
-            }
-            if(asize < get_size(block)){
-                block_t* temp = block;
-                size_t num = NUM_AHEAD;
-                size_t temp_size = get_size(block);
-
-                block = block->next_list;
-                while(num>0 && block !=NULL){
-                    if(get_size(block) < temp_size && get_size(block) >= asize){
-                        temp_size = get_size(block);
-                        temp = block;
-                    }
-                    num = num - 1;
-                    block = block->next_list;
-                }
-                dbg_assert(block != temp);
-                dbg_assert(num ==0 || block == NULL);
-                return temp;
-            }
-            block = block->next_list;
+    size_t index = size_class(asize);
+    if (index == tree_class) {
+        return tree_best_fit(asize);
+    }
+    size_t probes = NUM_PROBE;
+    for (block = heap->seg_list[index]; block != NULL && probes > 0;
+         block = safe_link(block, block->next_list), probes--) {
+        if (get_size(block) >= asize) {
+            return better_fit(block, asize);
         }
     }
-    return NULL;// no fit found
-    
+
+    // Classes above `index` that have at least one free block
+    word_t above = heap->class_bitmap & ((~(word_t)0 << index) << 1);
+    if (above == 0) {
+        return NULL;// no fit found
+    }
+    size_t next = __builtin_ctzll(above);
+    if (next == tree_class) {
+        return tree_best_fit(asize); // the smallest large block
+    }
+    return better_fit(heap->seg_list[next], asize);
 }
+/*
+ * ---------------------------------------------------------------------------
+ *                        DEFERRED COALESCING
+ * ---------------------------------------------------------------------------
+ *
+ * With quick_max set, free puts small blocks on a quick list for their
+ * exact size instead of coalescing them, and malloc of that size takes
+ * them back without a split: a program that frees and allocates the same
+ * sizes over and over skips the merge-then-split on every call. Quick
+ * blocks stay marked allocated, so the free lists and their neighbours
+ * never see them. They are all merged into the heap at once when find_fit
+ * comes up empty, when the lists grow past quick_limit bytes, and when a
+ * free coalesces into a block of trim_threshold bytes or more or leaves the
+ * quick blocks holding most of what is allocated (the heap may be emptying,
+ * and quick blocks would keep it from shrinking), as well as before a trim.
+ * Everything here needs the heap lock.
+ */
+
 /**
- * @brief this function finds a matching block in the free list
- * @param takes in a free block;
-*/
+ * @brief Marks an allocated block free and coalesces it with its
+ *        neighbours, then gives its memory back to the OS if it is big.
+ * @param[in] block An allocated block that is on no quick list
+ * @return The size of the free block after coalescing
+ */
+static size_t merge_block(block_t *block) {
+    size_t size = get_size(block);
 
+    // Mark the block as free
+    write_block(block, size, false, get_prev_alloc(block), get_mini_prev(block));
 
-static bool find_block(block_t* target){
-    size_t size = get_size(target);
-    block_t* block = seg_list[0];
-   if(size > dsize) {
-        size_t index = log_2((size-1));
-        
-        if(index > NUM_CLASS-1){
-            index = NUM_CLASS-1; 
-            block = seg_list[index];
-        }
-        else{
-            block = seg_list[index];
-        }
+    // Try to coalesce the block with its neighbors
+    block = coalesce_block(block);
+    size_t merged = get_size(block);
+    if (merged != size) {
+        heap->coalesce_count++;
     }
-    while(block!= NULL){
-           
-            if(get_size(block) == get_size(target) && get_alloc(block) == false){
-            return true;
-            }
-            block = block->next_list;
-        }
-    return false;
-
+    release_free_block(block);
+    return merged;
 }
 
 /**
- * @brief
+ * @brief Under MM_HARDEN, checks that an allocated block about to be pushed
+ *        onto the quick list or per-thread bin starting at `head` is not on
+ *        it already, and marks it as cached.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * The mark is the key in the block's second payload word, so the list is
+ * only searched when the block carries it: when it is cached already, or
+ * its payload happens to hold the same word. A mini block has no room for
+ * the mark and is only checked against the head.
  *
- * @param[in] line
- * @return
+ * @param[in] head The first block on the list
+ * @param[in] block The block being pushed
+ * @param[in] size Its size
  */
-bool mm_checkheap(int line) {
-
-    //check for epilogue and prologue
-    
-    block_t *epi = (block_t *)((char *) mem_heap_hi() -7);
-    if(get_size(epi) != 0 || get_alloc(epi) == false){ // check epilogue header is correct
-        dbg_printf("\n epi is wrong \n");
-        return false; 
+static void guard_push(block_t *head, block_t *block, size_t size) {
+    if (!hardened) {
+        return;
     }
-    //char* adn 
-    block_t *pro = (block_t *) ((char*) mem_heap_lo());
-    if(get_size(pro) != 0 || get_alloc(pro) == false){//check the prologue header is correct
-        dbg_printf("\n pro is wrong\n");
-        return false;
+    if (block == head) {
+        harden_fail("double free", header_to_payload(block));
     }
-
-    block_t *block;
-
-    //int count_free_block = 0; 
-    //printf("checkheap output:\n");
-    for (block = heap_start; get_size(block) > 0; block = find_next(block)) { //iterate through the heap
-   // printf("\ncurrent blockbt in loop is %lu\n",block->header);
-        if(get_alloc(block) == false){
-                if(find_block(block) == false){ // check free blocks in heap arein free list
-                    printf("the current size of block is %lu\n", get_size(block));
-                    dbg_printf("\nThe blocks did not match\n");
-                    return false;
-        
-                }
+    if (size <= dsize) {
+        return;
+    }
+    word_t *mark = (word_t *)header_to_payload(block) + 1;
+    if (*mark == ~header_key()) {
+        for (block_t *cached = head; cached != NULL;
+             cached = cached->next_list) {
+            if (cached == block) {
+                harden_fail("double free", header_to_payload(block));
+            }
+        }
+    }
+    *mark = ~header_key();
+}
+
+/**
+ * @brief Clears the mark of a block taken off a quick list or per-thread
+ *        bin (see guard_push).
+ */
+static void guard_pop(block_t *block, size_t size) {
+    if (hardened && size > dsize) {
+        ((word_t *)header_to_payload(block))[1] = 0;
+    }
+}
+
+/**
+ * @brief Puts an allocated block of `size` bytes on the quick list for its
+ *        size.
+ */
+static void quick_push(block_t *block, size_t size) {
+    size_t bin = size / dsize - 1;
+    dbg_requires(bin < QUICK_BINS);
+
+    guard_push(heap->quick_list[bin], block, size);
+    block->next_list = heap->quick_list[bin];
+    heap->quick_list[bin] = block;
+    heap->quick_blocks++;
+    heap->quick_bytes += size;
+}
+
+/**
+ * @brief Takes a block of exactly `asize` bytes off its quick list.
+ * @return The block, still marked allocated, or NULL if there is none
+ */
+static block_t *quick_pop(size_t asize) {
+    size_t bin = asize / dsize - 1;
+    if (bin >= QUICK_BINS || heap->quick_list[bin] == NULL) {
+        return NULL;
+    }
+
+    block_t *block = heap->quick_list[bin];
+    heap->quick_list[bin] = block->next_list;
+    heap->quick_blocks--;
+    heap->quick_bytes -= asize;
+    guard_pop(block, asize);
+    return block;
+}
+
+/**
+ * @brief Coalesces every block on the quick lists into the heap.
+ */
+static void quick_merge(void) {
+    for (size_t bin = 0; bin < QUICK_BINS && heap->quick_blocks != 0; bin++) {
+        while (heap->quick_list[bin] != NULL) {
+            block_t *block = heap->quick_list[bin];
+            heap->quick_list[bin] = block->next_list;
+            heap->quick_blocks--;
+            heap->quick_bytes -= get_size(block);
+            merge_block(block);
+        }
+    }
+}
+
+/**
+ * @brief Returns whether the quick lists should be merged because they
+ *        may be keeping the heap from shrinking.
+ *
+ * That is when they hold at least as many bytes as all other allocated
+ * blocks together, and enough bytes are free to trim (or release, if
+ * trimming is off). Blocks freed in any order leave a few quick blocks
+ * between free blocks too small to trim on their own, and this merges
+ * them once the heap empties.
+ */
+static bool quick_pinning(void) {
+    size_t give_back = trim_threshold != 0 ? trim_threshold : release_threshold;
+    if (heap->quick_blocks == 0 || give_back == 0 ||
+        heap->free_bytes < give_back) {
+        return false;
+    }
+    size_t held = heap_size() - heap->free_bytes;
+    return heap->quick_bytes >= held - heap->quick_bytes;
+}
+
+/**
+ * @brief find_fit, merging the quick lists and trying again if nothing
+ *        fits.
+ * @param[in] asize The adjusted size being allocated
+ * @return A free block that fits, or NULL if there is none
+ */
+static block_t *find_fit_merged(size_t asize) {
+    block_t *block = find_fit(asize);
+    if (block == NULL && heap->quick_blocks != 0) {
+        quick_merge();
+        block = find_fit(asize);
+    }
+    return block;
+}
+
+/**
+ * @brief Checks a free block marked as zeroed.
+ *
+ * Only the first and last words past its list links are looked at, so that
+ * the checker stays cheap on a heap of large zeroed blocks.
+ *
+ * @return True if the block is large enough to be marked, its footer is
+ *         marked too, and those words are zero
+ */
+static bool check_zeroed(block_t *block) {
+    word_t *first = (word_t *)((char *)block + sizeof(block_t));
+    word_t *footer = header_to_footer(block);
+    if (get_size(block) < sizeof(block_t) + wsize ||
+        (*footer & zero_mask) == 0) {
+        dbg_printf("zeroed block %p is badly marked\n", (void *)block);
+        return false;
+    }
+    if (first < footer && (*first != 0 || footer[-1] != 0)) {
+        dbg_printf("zeroed block %p is not zero\n", (void *)block);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks the quick lists and their counters.
+ * @return True if every quick block is an allocated heap block of its
+ *         list's size
+ */
+static bool check_quick_lists(void) {
+    size_t blocks = 0;
+    size_t bytes = 0;
+    for (size_t bin = 0; bin < QUICK_BINS; bin++) {
+        for (block_t *block = heap->quick_list[bin]; block != NULL;
+             block = block->next_list) {
+            if ((void *)block < heap_lo() || (void *)block > heap_hi() ||
+                !get_alloc(block) || get_size(block) != (bin + 1) * dsize) {
+                dbg_printf("quick_list[%zu] holds a bad block\n", bin);
+                return false;
+            }
+            blocks++;
+            bytes += get_size(block);
+        }
+    }
+    if (blocks != heap->quick_blocks || bytes != heap->quick_bytes) {
+        dbg_printf("quick list counters do not match the lists\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Makes check_map cover the current heap, all bits clear.
+ * @return False if no map could be had; membership is then checked by
+ *         counting only
+ */
+static bool check_map_reset(void) {
+    size_t bytes = round_up(heap_size() / dsize / 8 + 1, sizeof(uint64_t));
+    if (bytes > check_map_bytes) {
+        size_t length = round_up(max(bytes, 2 * check_map_bytes),
+                                 mem_pagesize());
+        void *map = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        if (check_map != NULL) {
+            munmap(check_map, check_map_bytes);
+        }
+        check_map = map;
+        check_map_bytes = length;
+    }
+    memset(check_map, 0, bytes);
+    return true;
+}
+
+/**
+ * @brief Flips the check_map bit of a block.
+ * @return The bit's old value
+ */
+static bool check_map_flip(block_t *block) {
+    size_t bit = (size_t)((char *)block - (char *)heap_lo()) / dsize;
+    uint64_t mask = (uint64_t)1 << (bit % 64);
+    bool old = (check_map[bit / 64] & mask) != 0;
+    check_map[bit / 64] ^= mask;
+    return old;
+}
+
+/**
+ * @brief Checks that a free block is linked into its class: its list
+ *        neighbours point back at it, or its tree parent and children do.
+ */
+static bool check_links(block_t *block) {
+    size_t index = size_class(get_size(block));
+    if (((heap->class_bitmap >> index) & 1) == 0) {
+        dbg_printf("free block %p has an empty class\n", (void *)block);
+        return false;
+    }
+    if (index == tree_class) {
+        block_t *parent = block->tree_parent;
+        if (!link_ok(parent) || !link_ok(block->tree_left) ||
+            !link_ok(block->tree_right)) {
+            dbg_printf("tree node %p has a wild link\n", (void *)block);
+            return false;
+        }
+        if ((parent == NULL ? heap->seg_list[index] != block
+                            : parent->tree_left != block &&
+                                  parent->tree_right != block) ||
+            (block->tree_left != NULL && block->tree_left->tree_parent != block) ||
+            (block->tree_right != NULL &&
+             block->tree_right->tree_parent != block)) {
+            dbg_printf("tree node %p is badly linked\n", (void *)block);
+            return false;
+        }
+        return true;
+    }
+    block_t *prev = list_prev(block);
+    block_t *next = list_next(block);
+    if (!link_ok(prev) || !link_ok(next)) {
+        dbg_printf("free block %p has a wild link\n", (void *)block);
+        return false;
+    }
+    if ((prev == NULL ? heap->seg_list[index] != block
+                      : list_next(prev) != block) ||
+        (next != NULL && list_prev(next) != block)) {
+        dbg_printf("free block %p is badly linked\n", (void *)block);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks one heap block against its neighbours without walking the
+ *        heap or the lists.
+ * @return True if the block lies in the heap and is aligned, the next
+ *         block's prev bits describe it, and, if it is free, its footer
+ *         matches, it has no free neighbour after it and it is linked into
+ *         its class
+ */
+static bool check_block(block_t *block) {
+    size_t size = get_size(block);
+    if ((void *)block < heap_lo() || (char *)block + size > (char *)heap_hi() ||
+        size < min_block_size || size % dsize != 0 ||
+        (uintptr_t)header_to_payload(block) % dsize != 0) {
+        dbg_printf("block %p is out of bounds or misaligned\n", (void *)block);
+        return false;
+    }
+    if (!tag_ok(block->header)) {
+        dbg_printf("block %p has a bad header tag\n", (void *)block);
+        return false;
+    }
+
+    block_t *next = find_next(block);
+    if (get_prev_alloc(next) != get_alloc(block) ||
+        get_mini_prev(next) != (size == dsize)) {
+        dbg_printf("block after %p has the wrong prev bits\n", (void *)block);
+        return false;
+    }
+
+    if (get_alloc(block)) {
+        if ((block->header & mmap_mask) != 0) {
+            dbg_printf("mmap bit set on heap block %p\n", (void *)block);
+            return false;
+        }
+        return true;
+    }
+    // The footer's prev bits may lag behind the header's
+    if (size > dsize && ((*header_to_footer(block) ^ block->header) &
+                         ~(prev_mask | mini_prev_mask)) != 0) {
+        dbg_printf("block %p header != footer\n", (void *)block);
+        return false;
+    }
+    if (!get_alloc(next)) {
+        dbg_printf("free block %p is followed by a free block\n",
+                   (void *)block);
+        return false;
+    }
+    if (get_zeroed(block) && !check_zeroed(block)) {
+        return false;
+    }
+    return check_links(block);
+}
+
+/**
+ * @brief Checks a block and the blocks on either side of it, which is what
+ *        an allocation or a free reads and writes.
+ */
+static bool check_touched(block_t *block) {
+    if (!check_block(block)) {
+        return false;
+    }
+    if (!get_prev_alloc(block)) {
+        block_t *prev =
+            get_mini_prev(block) ? find_prev_mini(block) : find_prev(block);
+        if (!check_block(prev) || find_next(prev) != block) {
+            dbg_printf("block before %p is corrupt\n", (void *)block);
+            return false;
+        }
+    }
+    block_t *next = find_next(block);
+    return get_size(next) == 0 || check_block(next);
+}
+
+/**
+ * @brief
+ *
+ * <What does this function do?>
+ * <What are the function's arguments?>
+ * <What is the function's return value?>
+ * <Are there any preconditions or postconditions?>
+ *
+ * @param[in] line
+ * @return
+ */
+bool mm_checkheap(int line) {
+
+    //check for epilogue and prologue
+    
+    block_t *epi = (block_t *)((char *) heap_hi() -7);
+    if(get_size(epi) != 0 || get_alloc(epi) == false){ // check epilogue header is correct
+        dbg_printf("\n epi is wrong \n");
+        return false; 
+    }
+    //char* adn 
+    block_t *pro = (block_t *) ((char*) heap_lo());
+    if(get_size(pro) != 0 || get_alloc(pro) == false){//check the prologue header is correct
+        dbg_printf("\n pro is wrong\n");
+        return false;
+    }
+
+    block_t *block;
+
+    //free blocks are marked in check_map, and each list member must find
+    //its mark: one pass over each instead of a list search per free block
+    bool mapped = check_map_reset();
+    size_t free_blocks = 0;
+    for (block = heap->heap_start; get_size(block) > 0; block = find_next(block)) { //iterate through the heap
+        if(get_alloc(block) == false){
+            free_blocks++;
+            if(mapped){
+                check_map_flip(block);
+            }
             if(get_size(block) > dsize){
                     if(extract_size((*header_to_footer(block))) != get_size(block) || extract_alloc(*header_to_footer(block)) != get_alloc(block)){ //check header and footer are the same 
                     //printf("here header not footer\n");
@@ -1044,8 +3206,15 @@ bool mm_checkheap(int line) {
 
                 }
             }
+            if(get_zeroed(block) && !check_zeroed(block)){ //a zeroed block must have its mark in both tags, and read zero
+                return false;
+            }
             
         }
+        else if((block->header & mmap_mask) != 0){ //heap blocks have no mapping of their own
+            dbg_printf("mmap bit set on a heap block\n");
+            return false;
+        }
        
         if(get_size(block) % wsize != 0 || get_payload_size(block) % wsize != 0 || ((uintptr_t) block->payload) % dsize != 0){ //check the address alignment of each block
             dbg_printf("\n not address aligned\n");
@@ -1061,56 +3230,132 @@ bool mm_checkheap(int line) {
 
     //checks for the seg_list
     for(size_t i = 0; i<NUM_CLASS; i++){
-        size_t min_size = (size_t) 1<<i; //2^i
-        size_t max_size = (size_t) 1<<(i+1);//2^(i+1)
+        block_t* cur = class_first(i);
+        block_t* prev = NULL;
+        size_t blocks = 0;
+        size_t bytes = 0;
 
-        block_t* cur = seg_list[i];
+        if(((heap->class_bitmap >> i) & 1) != (cur != NULL)){ //bitmap must mirror which lists are non-empty
+            dbg_printf("class bitmap does not match seg_list[%zu]\n", i);
+            return false;
+        }
 
   
         while(cur != NULL ){
            
             //check that the free list pointers are between lo and hi
-            if(((void *)cur) <  mem_heap_lo() || ((void *)cur) > mem_heap_hi()){ 
+            if(((void *)cur) <  heap_lo() || ((void *)cur) > heap_hi()){ 
 
                 dbg_printf("block is out of bounds \n");
                 return false;
             }
 
+            //check that the block is a free block of the heap, listed once
+            if(mapped && !check_map_flip(cur)){
+                dbg_printf("listed block %p is not a free heap block\n", (void *)cur);
+                return false;
+            }
+
+            //check that the tree is in order (its links are checked below)
+            if(i == tree_class && prev != NULL && !tree_less(prev, cur)){
+                dbg_printf("tree is out of order\n");
+                return false;
+            }
+
             //check that pointers are consistent
-             if(i > 0 && cur != NULL && cur->prev_list != NULL && cur->next_list != NULL && cur->next_list->prev_list != cur && cur->prev_list->next_list != cur){
+             if(i != tree_class && ((list_next(cur) != NULL && list_prev(list_next(cur)) != cur) || (list_prev(cur) != NULL && list_next(list_prev(cur)) != cur) || (cur == heap->seg_list[i] && list_prev(cur) != NULL))){
                 dbg_printf("block is not consistant\n");
                 return false;
             }
 
-            size_t cur_size = get_size(cur); 
-            if(min_size > cur_size || max_size < cur_size ){//check that the blocks in each bucket are within the bucket size range (2^i, 2^(i+1)) 
-                if((i!= 0 && i != NUM_CLASS-1) || cur_size < max_size ){
+            if(size_class(get_size(cur)) != i){//check that the blocks in each bucket are within the bucket size range
                 dbg_printf("the size of block was greater or less than the size range of bucket\n");
                 return false;
-                }
-                
             }
-            cur = cur->next_list;
+            blocks++;
+            bytes += get_size(cur);
+            prev = cur;
+            cur = class_next(cur);
+        }
+
+        if(i == tree_class && check_tree(heap->seg_list[i], NULL) < 0){
+            return false;
+        }
+
+        if(blocks != heap->class_blocks[i] || bytes != heap->class_bytes[i]){ //statistics must match the list
+            dbg_printf("class counters do not match seg_list[%zu]\n", i);
+            return false;
         }
+        free_blocks -= blocks;
 
     }
 
+    if(free_blocks != 0){ //every free block in the heap is on a list
+        dbg_printf("free blocks missing from seg_list\n");
+        return false;
+    }
+
+    size_t free_bytes = 0;
+    for (size_t i = 0; i < NUM_CLASS; i++) {
+        free_bytes += heap->class_bytes[i];
+    }
+    if (free_bytes != heap->free_bytes) {
+        dbg_printf("free_bytes does not match the class counters\n");
+        return false;
+    }
+
+
+    //checks for the blocks outside the heap, and the deferred ones
+    if(!check_mmap_chunks() || !check_slabs() || !check_quick_lists()){
+        return false;
+    }
     return true;
 }
 
 /**
- * @brief
+ * @brief Checks the heap around one operation, at the rates set with
+ *        MM_CHECK_RATE and MM_CHECK_FULL.
  *
- * Initializes the heap
- * 
- * Returns True
- * 
+ * Costs two loads and a branch while both are 0. A failed check prints
+ * where it was made and aborts, in release builds too.
  *
- * @return
+ * @param[in] block The heap block the operation touched, or NULL
+ * @param[in] line The caller's line, for the report
  */
-bool mm_init(void) {
+static void check_op(block_t *block, int line) {
+    if (check_rate == 0 && check_full == 0) {
+        return;
+    }
+
+    check_ops++;
+    bool ok = true;
+    if (check_full != 0 && check_ops % check_full == 0) {
+        ok = mm_checkheap(line);
+    } else if (check_rate != 0 && check_ops % check_rate == 0 &&
+               block != NULL) {
+        ok = check_touched(block);
+    }
+    if (!ok) {
+        fprintf(stderr, "mm: heap check failed at line %d\n", line);
+        abort();
+    }
+}
+
+/**
+ * @brief Sets up an empty current heap: prologue, epilogue, empty lists and
+ *        counters, and a first free block of chunksize_min bytes.
+ * @return False if the heap could not be grown
+ */
+static bool init_heap(void) {
+    // Memory past the break has not been written unless an earlier heap
+    // (before mem_reset_brk) reached further
+    char *brk = (char *)heap_hi() + 1;
+    if ((uintptr_t)heap->zero_brk < (uintptr_t)brk) {
+        heap->zero_brk = brk;
+    }
+
     // Create the initial empty heap
-    word_t *start = (word_t *)(mem_sbrk(2 * wsize));
+    word_t *start = (word_t *)(heap_sbrk(2 * wsize));
 
     if (start == (void *)-1) {
         return false;
@@ -1127,139 +3372,1994 @@ bool mm_init(void) {
     start[1] = pack(0, true,true, false); // Heap epilogue (block header)
 
     // Heap starts with first "block header", currently the epilogue
-    heap_start = (block_t *)&(start[1]);
+    heap->heap_start = (block_t *)&(start[1]);
     for(size_t i = 0; i < NUM_CLASS; i++){
         
-        seg_list[i] = NULL;
+        heap->seg_list[i] = NULL;
     
     } 
+    heap->class_bitmap = 0;
+    memset(heap->quick_list, 0, sizeof(heap->quick_list));
+    heap->quick_blocks = heap->quick_bytes = 0;
+    memset(heap->class_blocks, 0, sizeof(heap->class_blocks));
+    memset(heap->class_bytes, 0, sizeof(heap->class_bytes));
+    heap->free_bytes = 0;
+    heap->extend_count = heap->split_count = heap->coalesce_count = 0;
     // Extend the empty heap with a free block of chunksize bytes
-    if (extend_heap(chunksize) == NULL) {
+    heap->chunksize = chunksize_min;
+    heap->alloc_since_extend = 0;
+    if (extend_heap(heap->chunksize) == NULL) {
         return false;
     }
 
-    size_t index = log_2(get_size(heap_start)-1);
-    seg_list[index] = heap_start;
-    seg_list[index]->next_list = NULL;
-
     return true;
 }
 
 /**
  * @brief
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * Initializes the heap
+ * 
+ * Returns True
+ * 
+ * In thread-safe mode mm_init does not take the heap lock: it is called
+ * lazily by alloc_block with the lock held, and a direct call must not race
+ * with any other allocator call. Arenas are not affected.
  *
- * @param[in] size
  * @return
  */
-void *malloc(size_t size) {
-    dbg_requires(mm_checkheap(__LINE__));
-    //print_heap();
+bool mm_init(void) {
+    heap_generation++;
+    mmap_release_all();
+    slab_release_all();
+    memset(&op_counts, 0, sizeof(op_counts));
+    sample_reset_live();
+    latency_reset();
+    return init_heap();
+}
 
-    size_t asize;      // Adjusted block size
-    size_t extendsize; // Amount to extend heap if no fit is found
+/**
+ * @brief Allocates a block of `asize` bytes from the shared heap.
+ *
+ * This is the body of malloc: find a fit (extending the heap when there is
+ * none), take the block off its free list and split off what is not needed.
+ * In thread-safe mode the caller must hold the heap lock.
+ *
+ * When the block comes from a zeroed free block, only the few words of it
+ * that were written while it was free (its list links and footer) need
+ * clearing for the whole payload to read zero; calloc asks for that with
+ * `zeroed`.
+ *
+ * @param[in] asize The adjusted block size, as returned by adjust_size()
+ * @param[out] zeroed If not NULL, set to whether the payload was cleared
+ *                    this way
+ * @return The allocated block, or NULL if the heap could not be extended
+ */
+static block_t *alloc_block(size_t asize, bool *zeroed) {
     block_t *block;
-    void *bp = NULL;
 
     // Initialize heap if it isn't initialized
-    if (heap_start == NULL) {
+    if (heap->heap_start == NULL) {
         if (!(mm_init())) {
             dbg_printf("Problem initializing heap. Likely due to sbrk");
             return NULL;
         }
     }
 
-    // Ignore spurious request
-    if (size == 0) {
-        dbg_ensures(mm_checkheap(__LINE__));
-        return bp;
+    if (zeroed != NULL) {
+        *zeroed = false;
     }
 
-    // Adjust block size to include overhead and to meet alignment requirements
-    asize = round_up(size + wsize, dsize); //adjust block size for removing footers
-    asize = max(asize, min_block_size); 
-    
-    block = find_fit(asize);
+    // A deferred block of the same size needs no split at all
+    block = quick_pop(asize);
+    if (block != NULL) {
+        heap->alloc_since_extend += asize;
+        latency_set_path(MM_PATH_QUICK);
+        check_op(block, __LINE__);
+        return block;
+    }
+
+    block = find_fit_merged(asize);
+    int path = MM_PATH_FIT;
    
     // If no fit is found, request more memory, and then and place the block
     if (block == NULL) {
     
-        extendsize = max(asize, chunksize);
-        block = extend_heap(extendsize);
+        block = grow_heap(asize);
         // extend_heap returns an error
         if (block == NULL) {
-            return bp;
+            return NULL;
         }
+        path = MM_PATH_EXTEND;
     }
 
 
     // The block should be marked as free
     dbg_assert(!get_alloc(block));
 
-    // Mark block as allocated
+    // Take the block off its free list and mark it allocated
+    bool was_zeroed = get_zeroed(block);
+    delete(block);
     size_t block_size = get_size(block);
     write_block(block, block_size, true, get_prev_alloc(block), get_mini_prev(block));
     // Try to split the block if too large
-    split_block(block, asize);
-
-    bp = header_to_payload(block);
+    split_block(block, asize, was_zeroed);
+    heap->alloc_since_extend += asize;
+    if (path == MM_PATH_FIT && get_size(block) != block_size) {
+        path = MM_PATH_SPLIT;
+    }
+    latency_set_path(path);
+
+    if (zeroed != NULL && was_zeroed) {
+        char *bp = header_to_payload(block);
+        size_t payload = get_payload_size(block);
+        memset(bp, 0, min(payload, sizeof(block_t) - wsize));
+        memset(bp + payload - wsize, 0, wsize);
+        *zeroed = true;
+    }
 
-    dbg_ensures(mm_checkheap(__LINE__));
-    return bp;
+    check_op(block, __LINE__);
+    return block;
 }
 
 /**
- * @brief
+ * @brief Allocates a block of `asize` bytes whose payload is aligned to
+ *        `align` bytes.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * Finds a free block with room for the block at any alignment, then gives
+ * the slack in front of the aligned payload back to seg_list as a free
+ * block of its own (at least a mini block, so the slack is either zero or
+ * at least min_block_size) and splits off the tail as usual. In
+ * thread-safe mode the caller must hold the heap lock.
  *
- * @param[in] bp
+ * @param[in] align A power of two larger than dsize
+ * @param[in] asize The adjusted block size, as returned by adjust_size()
+ * @return The allocated block, or NULL if the heap could not be extended
  */
-void free(void *bp) {
-    dbg_requires(mm_checkheap(__LINE__));
-    
+static block_t *alloc_aligned_block(size_t align, size_t asize) {
+    dbg_requires(align > dsize && (align & (align - 1)) == 0);
 
-    if (bp == NULL) {
-        return;
+    if (heap->heap_start == NULL && !mm_init()) {
+        return NULL;
     }
 
-    block_t *block = payload_to_header(bp);
-    size_t size = get_size(block);
+    size_t search = asize + align + min_block_size;
+    block_t *block = find_fit_merged(search);
+    if (block == NULL) {
+        block = grow_heap(search);
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+    dbg_assert(!get_alloc(block));
 
-    // The block should be marked as allocated
+    bool zeroed = get_zeroed(block);
+    delete(block);
+    size_t size = get_size(block);
+    uintptr_t bp = (uintptr_t)header_to_payload(block);
+    uintptr_t ap = round_up(bp, align);
+    if (ap != bp && ap - bp < min_block_size) {
+        ap += align;
+    }
+    size_t slack = ap - bp;
+
+    if (slack == 0) {
+        write_block(block, size, true, get_prev_alloc(block), get_mini_prev(block));
+    } else {
+        // Write the aligned block first: writing the slack block then fixes
+        // up the aligned block's prev_alloc and mini_prev bits
+        block_t *aligned = (block_t *)((char *)block + slack);
+        write_block(aligned, size - slack, true, false, slack == dsize);
+        write_block(block, slack, false, get_prev_alloc(block), get_mini_prev(block));
+        if (zeroed) {
+            set_zeroed(block);
+        }
+        // Both neighbours of the slack are allocated, so there is nothing
+        // to coalesce with
+        add(block);
+        block = aligned;
+    }
+    split_block(block, asize, zeroed);
+
+    dbg_ensures((uintptr_t)header_to_payload(block) % align == 0);
+    check_op(block, __LINE__);
+    return block;
+}
+
+/**
+ * @brief Returns whether `bp` points into the heap (and not at a slab slot
+ *        or a mapped block).
+ *
+ * Safe without the heap lock for a live allocation: the break only moves
+ * under the lock, and never below an allocated block.
+ */
+static bool in_heap(const void *bp) {
+    return (const char *)bp > (const char *)mem_heap_lo() &&
+           (const char *)bp <= (const char *)mem_heap_hi();
+}
+
+/**
+ * @brief Checks, under MM_HARDEN, a pointer being freed that is not a slab
+ *        slot.
+ *
+ * It must be 16-byte aligned and its header must carry its tag. Unless it
+ * has a mapping of its own it must lie in its heap, the next block's header
+ * must carry its tag too (an overrun shows there), and both the block and
+ * the next block must say that it is allocated: the header of a block
+ * freed and merged into its neighbour is left behind in the merged block's
+ * payload, tag, alloc bit and all. Needs no lock for a live allocation.
+ *
+ * @param[in] bp The pointer
+ * @param[in] in_range Whether `bp` lies in the heap it is being freed to
+ */
+static void harden_free(void *bp, bool in_range) {
+    if (!hardened) {
+        return;
+    }
+    block_t *block = payload_to_header(bp);
+    if ((uintptr_t)bp % dsize != 0 || !tag_ok(header_load(block))) {
+        harden_fail("invalid free or corrupted header", bp);
+    }
+    if (is_mmapped(block)) {
+        return;
+    }
+    if (!in_range) {
+        harden_fail("invalid free", bp);
+    }
+    // An overrun of the block shows in the next one's header
+    block_t *next = find_next(block);
+    if (!tag_ok(header_load(next))) {
+        harden_fail("corrupted header", header_to_payload(next));
+    }
+    if (!get_alloc(block) || !get_prev_alloc(next)) {
+        harden_fail("double free", bp);
+    }
+}
+
+/**
+ * @brief Returns an allocated block to the shared heap.
+ *
+ * A block of at most quick_max bytes goes on its quick list, and the lists
+ * are merged once they exceed quick_limit bytes; any other block is marked
+ * free and coalesced with its neighbours, and the quick lists are merged
+ * too if that makes a block of trim_threshold bytes. Either way they are
+ * merged if they may be keeping an emptying heap from shrinking (see
+ * quick_pinning). In thread-safe mode the caller must hold the heap lock.
+ *
+ * @param[in] block An allocated block
+ * @param[in] size Its size, which a quick block needs no header read for
+ */
+static void free_block(block_t *block, size_t size) {
+    // The block should be marked as allocated
+    dbg_assert(get_alloc(block) && get_size(block) == size);
+    check_op(block, __LINE__);
+
+    if (size <= quick_max) {
+        latency_set_path(MM_PATH_QUICK);
+        quick_push(block, size);
+        if (heap->quick_bytes > quick_limit || quick_pinning()) {
+            quick_merge();
+        }
+        return;
+    }
+
+    bool prev_free = !get_prev_alloc(block);
+    bool next_free = !get_alloc(find_next(block));
+    latency_set_path(prev_free ? (next_free ? MM_PATH_COALESCE_BOTH
+                                            : MM_PATH_COALESCE_PREV)
+                               : (next_free ? MM_PATH_COALESCE_NEXT
+                                            : MM_PATH_COALESCE_NONE));
+    size_t merged = merge_block(block);
+    if ((merged >= trim_threshold && trim_threshold != 0 &&
+         heap->quick_blocks != 0) ||
+        quick_pinning()) {
+        quick_merge();
+    }
+}
+
+/**
+ * @brief Allocates up to `n` blocks of `asize` bytes from the shared heap in
+ *        one pass.
+ *
+ * Blocks waiting on the quick list of that size are taken first. The rest
+ * are carved back to back from a single free block of n * asize bytes (the
+ * heap grows once if there is none), so the whole batch costs one find_fit,
+ * one split and one coalesce. Only if that block cannot be had are the
+ * remaining blocks allocated one at a time. In thread-safe mode the caller
+ * must hold the heap lock.
+ *
+ * @param[in] asize The adjusted block size, as returned by adjust_size()
+ * @param[in] n The number of blocks wanted
+ * @param[out] out Where to store the payloads
+ * @return The number of blocks allocated, less than `n` only if the heap
+ *         could not be extended
+ */
+static size_t alloc_batch_blocks(size_t asize, size_t n, void **out) {
+    if (heap->heap_start == NULL && !mm_init()) {
+        return 0;
+    }
+
+    size_t done = 0;
+    block_t *block;
+    while (done < n && (block = quick_pop(asize)) != NULL) {
+        heap->alloc_since_extend += asize;
+        out[done++] = header_to_payload(block);
+    }
+
+    size_t want = n - done;
+    if (want > 1 && want <= SIZE_MAX / 4 / asize) {
+        size_t total = want * asize;
+        block = find_fit_merged(total);
+        if (block == NULL) {
+            block = grow_heap(total);
+        }
+        if (block != NULL) {
+            bool zeroed = get_zeroed(block);
+            delete(block);
+            size_t size = get_size(block);
+            bool prev_alloc = get_prev_alloc(block);
+            bool mini_prev = get_mini_prev(block);
+
+            // Allocated blocks have no footer, so all but the last need only
+            // a header; the last one takes the rest and is split as usual
+            for (size_t i = 1; i < want; i++) {
+                header_store(block, pack(asize, true, prev_alloc, mini_prev));
+                out[done++] = header_to_payload(block);
+                block = find_next(block);
+                size -= asize;
+                prev_alloc = true;
+                mini_prev = asize == dsize;
+            }
+            write_block(block, size, true, prev_alloc, mini_prev);
+            split_block(block, asize, zeroed);
+            out[done++] = header_to_payload(block);
+            heap->alloc_since_extend += total;
+        }
+    }
+
+    while (done < n && (block = alloc_block(asize, NULL)) != NULL) {
+        out[done++] = header_to_payload(block);
+    }
+
+    check_op(done != 0 ? payload_to_header(out[done - 1]) : NULL, __LINE__);
+    return done;
+}
+
+/**
+ * @brief Returns a batch of slab slots and allocated heap blocks, sorted by
+ *        address.
+ *
+ * Heap blocks that lie back to back are joined into one allocated block
+ * first, so that every run of neighbours is coalesced once. A run no larger
+ * than quick_max goes on its quick list instead, and the quick lists are
+ * merged at the end if free_block would have merged them for any of the
+ * runs. In thread-safe mode the caller must hold the heap lock.
+ *
+ * @param[in] ptrs Payloads of slab slots and heap blocks, in address order
+ * @param[in] n The number of payloads
+ */
+static void free_batch_blocks(void **ptrs, size_t n) {
+    size_t largest = 0;
+    size_t i = 0;
+    while (i < n) {
+        if (in_slab(ptrs[i])) {
+            slab_free(ptrs[i++]);
+            continue;
+        }
+
+        block_t *block = payload_to_header(ptrs[i]);
+        size_t size = get_size(block);
+        dbg_assert(get_alloc(block) && !is_mmapped(block));
+        check_op(block, __LINE__);
+        for (i++; i < n && payload_to_header(ptrs[i]) ==
+                               (block_t *)((char *)block + size);
+             i++) {
+            dbg_assert(get_alloc(payload_to_header(ptrs[i])));
+            size += get_size(payload_to_header(ptrs[i]));
+        }
+        if (size != get_size(block)) {
+            write_block(block, size, true, get_prev_alloc(block),
+                        get_mini_prev(block));
+            // write_block rewrote the next block's prev bits (mini_prev
+            // changes when the run ended in a mini block), so a free next
+            // block needs its footer rewritten to match
+            block_t *next = find_next(block);
+            if (!get_alloc(next) && get_size(next) > dsize) {
+                *header_to_footer(next) = next->header;
+            }
+        }
+
+        if (size <= quick_max) {
+            quick_push(block, size);
+        } else {
+            largest = max(largest, merge_block(block));
+        }
+    }
+
+    if (heap->quick_blocks != 0 &&
+        (heap->quick_bytes > quick_limit ||
+         (trim_threshold != 0 && largest >= trim_threshold))) {
+        quick_merge();
+    }
+}
+
+/**
+ * @brief Returns free memory to the OS.
+ *
+ * Shrinks the heap so that at most `pad` bytes of free space remain at its
+ * end, and releases the whole pages inside every other free block.
+ *
+ * @param[in] pad Bytes of free space to keep at the end of the heap
+ * @return The number of bytes given back
+ */
+size_t mm_trim(size_t pad) {
+    size_t released = 0;
+
+    heap_lock();
+    if (heap->heap_start != NULL) {
+        dbg_requires(mm_checkheap(__LINE__));
+        quick_merge();
+        released += trim_tail(pad);
+        for (size_t i = 0; i < NUM_CLASS; i++) {
+            for (block_t *block = class_first(i); block != NULL;
+                 block = class_next(block)) {
+                released += release_pages(block);
+            }
+        }
+        dbg_ensures(mm_checkheap(__LINE__));
+    }
+    heap_unlock();
+    return released;
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ *                        ARENAS
+ * ---------------------------------------------------------------------------
+ *
+ * An arena is a heap of its own, in a region of ARENA_REGION bytes reserved
+ * with mmap: it has its own segregated lists, tree and quick lists, and is
+ * grown, split and coalesced by the same code as the main heap, which it
+ * stands in for while an arena call holds the heap lock. Its heap_t sits at
+ * the start of the region, so destroying an arena is a single munmap however
+ * many blocks are still live. Arena blocks never come from slabs, mappings
+ * or per-thread caches, and only mm_arena_free may free them.
+ */
+
+/** @brief An arena: its heap state, then the heap itself */
+struct mm_arena {
+    heap_t heap;
+};
+
+/**
+ * @brief Takes the heap lock and makes the arena's heap the current heap.
+ */
+static void arena_enter(mm_arena_t *arena) {
+    heap_lock();
+    heap = &arena->heap;
+}
+
+/**
+ * @brief Makes the main heap current again and drops the heap lock.
+ */
+static void arena_leave(void) {
+    heap = &main_heap;
+    heap_unlock();
+}
+
+/**
+ * @brief Creates an empty arena.
+ *
+ * The region is only reserved, and pages are committed as the arena's heap
+ * grows into it.
+ *
+ * @return The arena, or NULL if the region could not be mapped
+ */
+mm_arena_t *mm_arena_create(void) {
+    void *base = mmap(NULL, ARENA_REGION, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Fresh pages read zero, so the rest of the heap state starts out empty
+    mm_arena_t *arena = base;
+    arena->heap.region_lo = (char *)base + round_up(sizeof(*arena), dsize);
+    arena->heap.region_brk = arena->heap.region_lo;
+    arena->heap.region_end = (char *)base + ARENA_REGION;
+
+    arena_enter(arena);
+    bool ok = init_heap();
+    arena_leave();
+    if (!ok) {
+        munmap(base, ARENA_REGION);
+        return NULL;
+    }
+    return arena;
+}
+
+/**
+ * @brief Allocates `size` bytes of 16-byte aligned memory from an arena.
+ * @param[in] arena An arena from mm_arena_create
+ * @param[in] size The number of payload bytes requested
+ * @return A pointer to the payload, or NULL if `size` is 0 or the arena's
+ *         region is full
+ */
+void *mm_arena_malloc(mm_arena_t *arena, size_t size) {
+    if (size == 0 || size > SIZE_MAX / 2) {
+        return NULL;
+    }
+
+    arena_enter(arena);
+    block_t *block = alloc_block(adjust_size(size), NULL);
+    arena_leave();
+    return block == NULL ? NULL : header_to_payload(block);
+}
+
+/**
+ * @brief Frees a block of an arena back into that arena.
+ * @param[in] arena The arena the block came from
+ * @param[in] bp A payload returned by mm_arena_malloc on `arena`, or NULL
+ */
+void mm_arena_free(mm_arena_t *arena, void *bp) {
+    if (bp == NULL) {
+        return;
+    }
+
+    block_t *block = payload_to_header(bp);
+    arena_enter(arena);
+    dbg_assert((void *)block > heap_lo() && (void *)block < heap_hi());
+    harden_free(bp, (void *)block > heap_lo() && (void *)block < heap_hi());
+    free_block(block, get_size(block));
+    arena_leave();
+}
+
+/**
+ * @brief Releases an arena and every block in it, without looking at them.
+ * @param[in] arena An arena from mm_arena_create, or NULL
+ */
+void mm_arena_destroy(mm_arena_t *arena) {
+    if (arena != NULL) {
+        munmap(arena, ARENA_REGION);
+    }
+}
+
+#ifdef MM_THREADS
+/*
+ * ---------------------------------------------------------------------------
+ *                        PER-THREAD BLOCK CACHES
+ * ---------------------------------------------------------------------------
+ *
+ * Each thread keeps a few blocks of every small size (up to
+ * TCACHE_BINS * dsize bytes) on private singly linked lists. Cached blocks
+ * stay marked allocated in the heap, so the shared lists and the heap
+ * checker never see them; malloc and free of small sizes are served from
+ * the cache without touching the heap lock. An empty bin is refilled, and
+ * a full bin is half flushed, with TCACHE_BATCH blocks per lock acquisition.
+ * Slab slots are cached the same way, in bins of their own.
+ */
+
+/** @brief Per-thread cache of free small blocks */
+typedef struct tcache {
+    /** @brief Cached blocks of size (i + 1) * dsize, linked by next_list */
+    block_t *bins[TCACHE_BINS];
+    /** @brief Number of blocks in each bin */
+    unsigned count[TCACHE_BINS];
+    /** @brief Cached slots of slab class i, linked through their first word */
+    void *slab_bins[SLAB_CLASSES];
+    unsigned slab_count[SLAB_CLASSES];
+    /** @brief Value of heap_generation when the cache was filled */
+    unsigned long generation;
+    /** @brief True once the thread-exit destructor is registered */
+    bool registered;
+    /** @brief This thread's entry point calls, read by mm_stats */
+    op_counts_t counts;
+    /** @brief Links on tcache_list */
+    struct tcache *next_cache;
+    struct tcache *prev_cache;
+} tcache_t;
+
+static __thread tcache_t tcache;
+
+/** @brief Caches of all live threads that have used the allocator, so that
+ *         mm_stats can add up their counters (protected by the heap lock) */
+static tcache_t *tcache_list = NULL;
+
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief guard_push for a slab slot pushed onto the per-thread bin starting
+ *        at `head`.
+ *
+ * Slots are linked through their first word, and every slot has a second
+ * one for the mark. A slot freed twice with a flush back to its run in
+ * between is caught by slab_free instead.
+ */
+static void guard_push_slot(void *head, void *bp) {
+    if (!hardened) {
+        return;
+    }
+    word_t *mark = (word_t *)bp + 1;
+    if (bp == head || *mark == ~header_key()) {
+        for (void *cached = head; cached != NULL; cached = *(void **)cached) {
+            if (cached == bp) {
+                harden_fail("double free", bp);
+            }
+        }
+    }
+    *mark = ~header_key();
+}
+
+/**
+ * @brief Clears the mark of a slot taken off a per-thread bin.
+ */
+static void guard_pop_slot(void *bp) {
+    if (hardened) {
+        ((word_t *)bp)[1] = 0;
+    }
+}
+
+/**
+ * @brief Hands `n` blocks of one bin back to the shared heap.
+ * @param[in] cache The calling thread's cache
+ * @param[in] bin The bin to take the blocks from
+ * @param[in] n The number of blocks to flush
+ */
+static void tcache_flush(tcache_t *cache, size_t bin, unsigned n) {
+    heap_lock();
+    while (n > 0 && cache->bins[bin] != NULL) {
+        block_t *block = cache->bins[bin];
+        cache->bins[bin] = block->next_list;
+        cache->count[bin]--;
+        guard_pop(block, get_size(block));
+        free_block(block, get_size(block));
+        n--;
+    }
+    heap_unlock();
+}
+
+/**
+ * @brief Hands `n` slots of one slab bin back to their runs.
+ * @param[in] cache The calling thread's cache
+ * @param[in] cls The slab class of the bin
+ * @param[in] n The number of slots to flush
+ */
+static void tcache_slab_flush(tcache_t *cache, size_t cls, unsigned n) {
+    heap_lock();
+    while (n > 0 && cache->slab_bins[cls] != NULL) {
+        void *bp = cache->slab_bins[cls];
+        cache->slab_bins[cls] = *(void **)bp;
+        cache->slab_count[cls]--;
+        guard_pop_slot(bp);
+        slab_free(bp);
+        n--;
+    }
+    heap_unlock();
+}
+
+/**
+ * @brief Flushes every bin of an exiting thread's cache.
+ * @param[in] arg The exiting thread's cache
+ */
+static void tcache_destroy(void *arg) {
+    tcache_t *cache = arg;
+    if (cache->generation == heap_generation) {
+        for (size_t bin = 0; bin < TCACHE_BINS; bin++) {
+            tcache_flush(cache, bin, cache->count[bin]);
+        }
+        for (size_t cls = 0; cls < SLAB_CLASSES; cls++) {
+            tcache_slab_flush(cache, cls, cache->slab_count[cls]);
+        }
+    }
+
+    heap_lock();
+    if (cache->generation == heap_generation) {
+        op_counts.mallocs += cache->counts.mallocs;
+        op_counts.frees += cache->counts.frees;
+        op_counts.reallocs += cache->counts.reallocs;
+        op_counts.callocs += cache->counts.callocs;
+    }
+    if (cache->prev_cache != NULL) {
+        cache->prev_cache->next_cache = cache->next_cache;
+    } else {
+        tcache_list = cache->next_cache;
+    }
+    if (cache->next_cache != NULL) {
+        cache->next_cache->prev_cache = cache->prev_cache;
+    }
+    heap_unlock();
+}
+
+static void tcache_key_create(void) {
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/**
+ * @brief Readies the calling thread's cache for use.
+ *
+ * Registers the thread-exit flush and links the cache on tcache_list on
+ * first use, and empties the cache (and its counters) without flushing it
+ * if the heap was reinitialized since it was filled.
+ *
+ * @return The calling thread's cache
+ */
+static tcache_t *tcache_get_cache(void) {
+    tcache_t *cache = &tcache;
+    if (!cache->registered) {
+        pthread_once(&tcache_key_once, tcache_key_create);
+        pthread_setspecific(tcache_key, cache);
+        heap_lock();
+        cache->prev_cache = NULL;
+        cache->next_cache = tcache_list;
+        if (tcache_list != NULL) {
+            tcache_list->prev_cache = cache;
+        }
+        tcache_list = cache;
+        heap_unlock();
+        cache->registered = true;
+    }
+    if (cache->generation != heap_generation) {
+        for (size_t bin = 0; bin < TCACHE_BINS; bin++) {
+            cache->bins[bin] = NULL;
+            cache->count[bin] = 0;
+        }
+        for (size_t cls = 0; cls < SLAB_CLASSES; cls++) {
+            cache->slab_bins[cls] = NULL;
+            cache->slab_count[cls] = 0;
+        }
+        memset(&cache->counts, 0, sizeof(cache->counts));
+        cache->generation = heap_generation;
+    }
+    return cache;
+}
+
+/**
+ * @brief Allocates a small block from the calling thread's cache.
+ *
+ * An empty bin is refilled with TCACHE_BATCH blocks under a single
+ * acquisition of the heap lock.
+ *
+ * @param[in] asize The adjusted block size
+ * @return An allocated block, or NULL if `asize` is not cached or the heap
+ *         is exhausted
+ */
+static block_t *tcache_alloc(size_t asize) {
+    size_t bin = asize / dsize - 1;
+    if (bin >= TCACHE_BINS) {
+        return NULL;
+    }
+
+    tcache_t *cache = tcache_get_cache();
+    if (cache->bins[bin] == NULL) {
+        heap_lock();
+        for (unsigned i = 0; i < TCACHE_BATCH; i++) {
+            block_t *block = alloc_block(asize, NULL);
+            if (block == NULL) {
+                break;
+            }
+            block->next_list = cache->bins[bin];
+            cache->bins[bin] = block;
+            cache->count[bin]++;
+        }
+        // mm_init may have run for the first time inside alloc_block
+        cache->generation = heap_generation;
+        heap_unlock();
+        if (cache->bins[bin] == NULL) {
+            return NULL;
+        }
+    }
+
+    block_t *block = cache->bins[bin];
+    cache->bins[bin] = block->next_list;
+    cache->count[bin]--;
+    guard_pop(block, asize);
+    return block;
+}
+
+/**
+ * @brief Puts a freed small block into the calling thread's cache.
+ *
+ * A full bin first has TCACHE_BATCH blocks flushed back to the heap.
+ *
+ * @param[in] block An allocated block
+ * @param[in] size Its size
+ * @return True if the block was cached, false if its size is not cached
+ */
+static bool tcache_free(block_t *block, size_t size) {
+    size_t bin = size / dsize - 1;
+    if (bin >= TCACHE_BINS) {
+        return false;
+    }
+
+    tcache_t *cache = tcache_get_cache();
+    guard_push(cache->bins[bin], block, size);
+    if (cache->count[bin] >= TCACHE_FILL) {
+        tcache_flush(cache, bin, TCACHE_BATCH);
+    }
+    block->next_list = cache->bins[bin];
+    cache->bins[bin] = block;
+    cache->count[bin]++;
+    return true;
+}
+
+/**
+ * @brief Allocates a slot of slab class `cls` from the calling thread's
+ *        cache, refilling an empty bin with TCACHE_BATCH slots.
+ * @param[in] cls A slab class
+ * @return A slot, or NULL if no run could be had
+ */
+static void *tcache_slab_alloc(size_t cls) {
+    tcache_t *cache = tcache_get_cache();
+    if (cache->slab_bins[cls] == NULL) {
+        heap_lock();
+        for (unsigned i = 0; i < TCACHE_BATCH; i++) {
+            void *bp = slab_alloc(cls);
+            if (bp == NULL) {
+                break;
+            }
+            *(void **)bp = cache->slab_bins[cls];
+            cache->slab_bins[cls] = bp;
+            cache->slab_count[cls]++;
+        }
+        // mm_init may have run for the first time inside slab_alloc
+        cache->generation = heap_generation;
+        heap_unlock();
+        if (cache->slab_bins[cls] == NULL) {
+            return NULL;
+        }
+    }
+
+    void *bp = cache->slab_bins[cls];
+    cache->slab_bins[cls] = *(void **)bp;
+    cache->slab_count[cls]--;
+    guard_pop_slot(bp);
+    return bp;
+}
+
+/**
+ * @brief Puts a freed slab slot into the calling thread's cache, first
+ *        flushing TCACHE_BATCH slots of a full bin.
+ * @param[in] bp A slot returned by slab_alloc
+ * @return True (every slot is cached)
+ */
+static bool tcache_slab_free(void *bp) {
+    size_t cls = slab_run_of(bp)->cls;
+    tcache_t *cache = tcache_get_cache();
+    guard_push_slot(cache->slab_bins[cls], bp);
+    if (cache->slab_count[cls] >= TCACHE_FILL) {
+        tcache_slab_flush(cache, cls, TCACHE_BATCH);
+    }
+    *(void **)bp = cache->slab_bins[cls];
+    cache->slab_bins[cls] = bp;
+    cache->slab_count[cls]++;
+    return true;
+}
+
+/**
+ * @brief Returns the entry point counters of the calling thread.
+ */
+static op_counts_t *thread_counts(void) {
+    return &tcache_get_cache()->counts;
+}
+
+/**
+ * @brief Adds up the counters of all threads. Needs the heap lock.
+ * @param[out] total Where to add them
+ */
+static void sum_thread_counts(op_counts_t *total) {
+    for (tcache_t *cache = tcache_list; cache != NULL;
+         cache = cache->next_cache) {
+        if (__atomic_load_n(&cache->generation, __ATOMIC_RELAXED) !=
+            heap_generation) {
+            continue;
+        }
+        total->mallocs += __atomic_load_n(&cache->counts.mallocs, __ATOMIC_RELAXED);
+        total->frees += __atomic_load_n(&cache->counts.frees, __ATOMIC_RELAXED);
+        total->reallocs += __atomic_load_n(&cache->counts.reallocs, __ATOMIC_RELAXED);
+        total->callocs += __atomic_load_n(&cache->counts.callocs, __ATOMIC_RELAXED);
+    }
+}
+
+#else /* !MM_THREADS */
+
+static block_t *tcache_alloc(size_t asize) {
+    return NULL;
+}
+
+static bool tcache_free(block_t *block, size_t size) {
+    return false;
+}
+
+static void *tcache_slab_alloc(size_t cls) {
+    return NULL;
+}
+
+static bool tcache_slab_free(void *bp) {
+    return false;
+}
+
+static op_counts_t *thread_counts(void) {
+    return &op_counts;
+}
+
+static void sum_thread_counts(op_counts_t *total) {
+}
+
+#endif /* MM_THREADS */
+
+/**
+ * @brief Bumps one of the calling thread's entry point counters.
+ *
+ * Only the owning thread writes a counter; the relaxed atomic store lets
+ * mm_stats read it from another thread without taking any lock here.
+ *
+ * @param[in] counter A field of thread_counts()
+ */
+static void count_op(size_t *counter) {
+    __atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Bumps one of the calling thread's entry point counters by `n`, for
+ *        the batch entry points (see count_op).
+ */
+static void count_ops(size_t *counter, size_t n) {
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Fills in the allocator's counters without walking the heap.
+ *
+ * Heap and free-list figures are exact at the time of the call. Blocks in
+ * per-thread caches count as in use. Call counts are per entry point, so
+ * the malloc and free a moving realloc makes, and the malloc inside calloc,
+ * are counted as well; the batch calls count once per object.
+ *
+ * @param[out] stats Where to store the counters
+ */
+void mm_stats(mm_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    heap_lock();
+    if (heap->heap_start != NULL) {
+        stats->heap_size = mem_heapsize();
+    }
+    stats->num_classes = NUM_CLASS;
+    for (size_t i = 0; i < NUM_CLASS; i++) {
+        stats->class_blocks[i] = heap->class_blocks[i];
+        stats->class_bytes[i] = heap->class_bytes[i];
+        stats->bytes_free += heap->class_bytes[i];
+    }
+    if (stats->heap_size != 0) {
+        // Everything but the prologue, the epilogue and the free blocks
+        stats->bytes_in_use = stats->heap_size - 2 * wsize - stats->bytes_free;
+        stats->fragmentation = 1.0 - (double)stats->bytes_in_use /
+                                         (double)stats->heap_size;
+    }
+    stats->mmap_count = mmap_count;
+    stats->mmap_bytes = mmap_bytes;
+    stats->slab_runs = slab_runs;
+    stats->slab_size = slab_runs * SLAB_RUN;
+    stats->slab_bytes = slab_bytes;
+    stats->quick_blocks = heap->quick_blocks;
+    stats->quick_bytes = heap->quick_bytes;
+    stats->extends = heap->extend_count;
+    stats->splits = heap->split_count;
+    stats->coalesces = heap->coalesce_count;
+
+    op_counts_t total = op_counts;
+    sum_thread_counts(&total);
+    stats->mallocs = total.mallocs;
+    stats->frees = total.frees;
+    stats->reallocs = total.reallocs;
+    stats->callocs = total.callocs;
+    heap_unlock();
+}
+
+/**
+ * @brief Writes the counters from mm_stats to `out` as one JSON object.
+ * @param[in] out The stream to write to
+ */
+void mm_stats_print(FILE *out) {
+    mm_stats_t stats;
+    mm_stats(&stats);
+
+    fprintf(out, "{\"heap_size\":%zu,\"bytes_in_use\":%zu,\"bytes_free\":%zu,",
+            stats.heap_size, stats.bytes_in_use, stats.bytes_free);
+    fprintf(out, "\"mmap_count\":%zu,\"mmap_bytes\":%zu,",
+            stats.mmap_count, stats.mmap_bytes);
+    fprintf(out, "\"slab_runs\":%zu,\"slab_size\":%zu,\"slab_bytes\":%zu,",
+            stats.slab_runs, stats.slab_size, stats.slab_bytes);
+    fprintf(out, "\"quick_blocks\":%zu,\"quick_bytes\":%zu,",
+            stats.quick_blocks, stats.quick_bytes);
+    fprintf(out, "\"mallocs\":%zu,\"frees\":%zu,\"reallocs\":%zu,\"callocs\":%zu,",
+            stats.mallocs, stats.frees, stats.reallocs, stats.callocs);
+    fprintf(out, "\"extends\":%zu,\"splits\":%zu,\"coalesces\":%zu,",
+            stats.extends, stats.splits, stats.coalesces);
+    fprintf(out, "\"fragmentation\":%.4f,\"classes\":[", stats.fragmentation);
+    for (size_t i = 0; i < stats.num_classes; i++) {
+        fprintf(out, "%s{\"blocks\":%zu,\"bytes\":%zu}", i == 0 ? "" : ",",
+                stats.class_blocks[i], stats.class_bytes[i]);
+    }
+    fprintf(out, "]}\n");
+}
+
+static const char *const latency_op_names[MM_NUM_OPS] = {
+    "malloc", "free", "realloc", "calloc", "malloc_batch", "free_batch"};
+
+static const char *const latency_path_names[MM_NUM_PATHS] = {
+    "slab",          "cache",         "quick",         "fit",
+    "split",         "extend",        "mmap",          "coalesce_none",
+    "coalesce_prev", "coalesce_next", "coalesce_both", "in_place",
+    "move",          "batch",         "other"};
+
+/**
+ * @brief Copies the latency histograms.
+ *
+ * They count every call since mm_init, under the path it took: a moving
+ * realloc is counted once, as a realloc, and not as a malloc and a free.
+ *
+ * @param[out] out Where to store them; zeroed without MM_LATENCY
+ * @return False if the allocator was built without MM_LATENCY
+ */
+bool mm_latency(mm_latency_t *out) {
+#ifdef MM_LATENCY
+    for (size_t op = 0; op < MM_NUM_OPS; op++) {
+        for (size_t path = 0; path < MM_NUM_PATHS; path++) {
+            for (size_t b = 0; b < MM_LATENCY_BUCKETS; b++) {
+                out->count[op][path][b] =
+                    __atomic_load_n(&latency[op][path][b], __ATOMIC_RELAXED);
+            }
+        }
+    }
+    return true;
+#else
+    memset(out, 0, sizeof(*out));
+    return false;
+#endif
+}
+
+/**
+ * @brief The upper bound of the bucket below which `permille` thousandths
+ *        of the calls in `buckets` fall, in nanoseconds.
+ */
+static size_t latency_percentile(const size_t *buckets, size_t count,
+                                 unsigned permille) {
+    size_t rank = count * permille / 1000;
+    size_t seen = 0;
+    for (size_t b = 0; b < MM_LATENCY_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen > rank) {
+            return (size_t)1 << b;
+        }
+    }
+    return (size_t)1 << (MM_LATENCY_BUCKETS - 1);
+}
+
+/**
+ * @brief Writes the latency histograms to `out` as one JSON object: per
+ *        entry point, per path that was taken, the calls, the p50, p99 and
+ *        p999 bucket bounds in nanoseconds, and the buckets.
+ * @param[in] out The stream to write to
+ */
+void mm_latency_print(FILE *out) {
+    mm_latency_t lat;
+    mm_latency(&lat);
+
+    fprintf(out, "{");
+    for (size_t op = 0; op < MM_NUM_OPS; op++) {
+        fprintf(out, "%s\"%s\":{", op == 0 ? "" : ",", latency_op_names[op]);
+        bool first = true;
+        for (size_t path = 0; path < MM_NUM_PATHS; path++) {
+            const size_t *buckets = lat.count[op][path];
+            size_t count = 0;
+            for (size_t b = 0; b < MM_LATENCY_BUCKETS; b++) {
+                count += buckets[b];
+            }
+            if (count == 0) {
+                continue;
+            }
+            fprintf(out,
+                    "%s\"%s\":{\"count\":%zu,\"p50_ns\":%zu,\"p99_ns\":%zu,"
+                    "\"p999_ns\":%zu,\"buckets\":[",
+                    first ? "" : ",", latency_path_names[path], count,
+                    latency_percentile(buckets, count, 500),
+                    latency_percentile(buckets, count, 990),
+                    latency_percentile(buckets, count, 999));
+            for (size_t b = 0; b < MM_LATENCY_BUCKETS; b++) {
+                fprintf(out, "%s%zu", b == 0 ? "" : ",", buckets[b]);
+            }
+            fprintf(out, "]}");
+            first = false;
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "}\n");
+}
+
+/** @brief One heap block as mm_snapshot records it */
+typedef struct snapshot_block {
+    /** @brief Offset of the header from the start of the heap */
+    size_t offset;
+    size_t size;
+    /** @brief The header's alloc, prev_alloc and mini_prev bits, plus
+     *         snapshot_zeroed and snapshot_quick */
+    unsigned flags;
+} snapshot_block_t;
+
+/**
+ * @brief Copies the block map and the free lists of the current heap into
+ *        a fresh mapping, so that they can be printed without the lock.
+ *
+ * The map holds `*num_blocks` blocks in address order, then, as offsets,
+ * the members of each class in list (or tree) order; `counts` gets the
+ * number of members per class.
+ *
+ * @return The mapping, of `*length` bytes, or NULL if there is no heap or
+ *         no memory
+ */
+static snapshot_block_t *snapshot_copy(size_t *num_blocks,
+                                       size_t counts[NUM_CLASS],
+                                       size_t *length) {
+    if (heap->heap_start == NULL || !check_map_reset()) {
+        return NULL;
+    }
+
+    size_t blocks = 0;
+    size_t listed = 0;
+    for (block_t *block = heap->heap_start; get_size(block) > 0;
+         block = find_next(block)) {
+        blocks++;
+    }
+    for (size_t i = 0; i < NUM_CLASS; i++) {
+        listed += heap->class_blocks[i];
+    }
+    *length = round_up(blocks * sizeof(snapshot_block_t) +
+                           listed * sizeof(size_t) + 1,
+                       mem_pagesize());
+    snapshot_block_t *map = mmap(NULL, *length, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Quick blocks look allocated; mark them in check_map to tell them apart
+    for (size_t bin = 0; bin < QUICK_BINS; bin++) {
+        for (block_t *block = heap->quick_list[bin]; block != NULL;
+             block = block->next_list) {
+            check_map_flip(block);
+        }
+    }
+
+    char *lo = heap_lo();
+    snapshot_block_t *entry = map;
+    for (block_t *block = heap->heap_start; get_size(block) > 0;
+         block = find_next(block)) {
+        entry->offset = (size_t)((char *)block - lo);
+        entry->size = get_size(block);
+        entry->flags = (unsigned)(block->header &
+                                  (alloc_mask | prev_mask | mini_prev_mask));
+        if (!get_alloc(block) && get_zeroed(block)) {
+            entry->flags |= snapshot_zeroed;
+        }
+        if (get_alloc(block) && check_map_flip(block)) {
+            entry->flags |= snapshot_quick;
+        }
+        entry++;
+    }
+
+    size_t *offsets = (size_t *)entry;
+    for (size_t i = 0; i < NUM_CLASS; i++) {
+        counts[i] = 0;
+        for (block_t *block = class_first(i); block != NULL;
+             block = class_next(block)) {
+            *offsets++ = (size_t)((char *)block - lo);
+            counts[i]++;
+        }
+    }
+    *num_blocks = blocks;
+    return map;
+}
+
+/**
+ * @brief Writes the layout of the heap to `out` as one JSON object on one
+ *        line, for bench/heap_report.c.
+ *
+ * Blocks are [offset, size, flags] triples in address order, offsets being
+ * from the first byte of the heap; flags has the header's alloc (1),
+ * prev_alloc (2) and mini_prev (4) bits, 8 for a zeroed free block and 16
+ * for a block waiting on a quick list. Classes lists each seg_list class as
+ * the offsets of its members, in list order. Mapped blocks, slabs and
+ * per-thread caches are left out. The heap is copied under the lock and
+ * printed after, so that printing may allocate.
+ *
+ * @param[in] out The stream to write to
+ * @param[in] label Written as "label" if not NULL, to tell snapshots apart;
+ *                  it is not escaped
+ * @return False if there is no heap yet or no memory for the copy
+ */
+bool mm_snapshot(FILE *out, const char *label) {
+    size_t num_blocks;
+    size_t counts[NUM_CLASS];
+    size_t length;
+    mm_stats_t stats;
+
+    mm_stats(&stats);
+    heap_lock();
+    snapshot_block_t *map = snapshot_copy(&num_blocks, counts, &length);
+    size_t chunksize = heap->chunksize;
+    heap_unlock();
+    if (map == NULL) {
+        return false;
+    }
+
+    fprintf(out, "{");
+    if (label != NULL) {
+        fprintf(out, "\"label\":\"%s\",", label);
+    }
+    fprintf(out, "\"ops\":%zu,\"heap_size\":%zu,\"chunksize\":%zu,"
+                 "\"blocks\":[",
+            stats.mallocs + stats.frees + stats.reallocs + stats.callocs,
+            stats.heap_size, chunksize);
+    for (size_t i = 0; i < num_blocks; i++) {
+        fprintf(out, "%s[%zu,%zu,%u]", i == 0 ? "" : ",", map[i].offset,
+                map[i].size, map[i].flags);
+    }
+    fprintf(out, "],\"classes\":[");
+    size_t *offsets = (size_t *)(map + num_blocks);
+    for (size_t i = 0; i < NUM_CLASS; i++) {
+        fprintf(out, "%s[", i == 0 ? "" : ",");
+        for (size_t j = 0; j < counts[i]; j++) {
+            fprintf(out, "%s%zu", j == 0 ? "" : ",", *offsets++);
+        }
+        fprintf(out, "]");
+    }
+    fprintf(out, "]}\n");
+
+    munmap(map, length);
+    return true;
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ *                        ALLOCATION SAMPLING
+ * ---------------------------------------------------------------------------
+ * With MM_SAMPLE_RATE set, one allocation in about every sample_rate bytes
+ * allocated is sampled: its stack is recorded and it is followed until it
+ * is freed. Samples are added up per stack (call site) and written out by
+ * mm_profile_pprof and mm_profile_print. Allocations only count down a
+ * per-thread byte counter, and frees only read sample_live, unless a sample
+ * is due or live. The tables are mapped on first use and protected by the
+ * heap lock.
+ */
+
+/** @brief Sampled allocations from one stack */
+typedef struct sample_site {
+    void *stack[SAMPLE_DEPTH];
+    unsigned depth;
+    /** @brief Samples taken, their requested and usable bytes */
+    size_t allocs;
+    size_t bytes;
+    size_t usable_bytes;
+    /** @brief Samples not freed yet, and their requested bytes */
+    size_t live;
+    size_t live_bytes;
+    /** @brief Samples freed, and their lifetimes added up */
+    size_t frees;
+    uint64_t lifetime_ns;
+} sample_site_t;
+
+/** @brief A sampled allocation that is still live */
+typedef struct sample_live {
+    /** @brief Its payload, NULL for an empty slot */
+    void *bp;
+    size_t size;
+    uint64_t start_ns;
+    sample_site_t *site;
+} sample_live_t;
+
+/** @brief Bytes between samples on average, 0 if sampling is off */
+static size_t sample_rate;
+
+/** @brief Number of entries in sample_table; frees look here first */
+static size_t sample_live;
+
+/** @brief Samples not taken because a table was full */
+static size_t sample_dropped;
+
+static sample_site_t *sample_sites;
+static size_t sample_num_sites;
+static sample_live_t *sample_table;
+
+#ifdef MM_THREADS
+/** @brief Bytes this thread allocates before its next sample */
+static __thread size_t sample_left;
+/** @brief Set while this thread takes a sample, which may allocate */
+static __thread bool sample_busy;
+static __thread uint64_t sample_seed;
+#else
+static size_t sample_left;
+static bool sample_busy;
+static uint64_t sample_seed;
+#endif
+
+static uint64_t sample_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Maps the sample tables if they are not mapped yet. Needs the heap
+ *        lock.
+ * @return False if they could not be mapped
+ */
+static bool sample_tables(void) {
+    if (sample_table != NULL) {
+        return true;
+    }
+    sample_site_t *sites = mmap(NULL, SAMPLE_SITES * sizeof(sample_site_t),
+                                PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    sample_live_t *table = mmap(NULL, SAMPLE_LIVE * sizeof(sample_live_t),
+                                PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (sites == MAP_FAILED || table == MAP_FAILED) {
+        if (sites != MAP_FAILED) {
+            munmap(sites, SAMPLE_SITES * sizeof(sample_site_t));
+        }
+        if (table != MAP_FAILED) {
+            munmap(table, SAMPLE_LIVE * sizeof(sample_live_t));
+        }
+        return false;
+    }
+    sample_sites = sites;
+    sample_table = table;
+    return true;
+}
+
+/**
+ * @brief Bytes until the next sample: uniform in [rate / 2, 3 * rate / 2),
+ *        so that sampling does not lock on to a periodic pattern.
+ */
+static size_t sample_interval(size_t rate) {
+    if (sample_seed == 0) {
+        sample_seed = (uintptr_t)&sample_seed | 1;
+    }
+    sample_seed ^= sample_seed << 13;
+    sample_seed ^= sample_seed >> 7;
+    sample_seed ^= sample_seed << 17;
+    return rate / 2 + (size_t)(sample_seed % rate) + 1;
+}
+
+/**
+ * @brief Starts the calling thread's countdown over, after the sampling
+ *        rate has changed. Other threads pick the change up within
+ *        SAMPLE_RECHECK bytes, or at their next sample.
+ */
+static void sample_restart(void) {
+    size_t rate = sample_rate;
+    sample_left = rate != 0 ? sample_interval(rate) : SAMPLE_RECHECK;
+}
+
+static size_t sample_slot(const void *bp) {
+    return (size_t)(((uintptr_t)bp >> 4) * 0x9e3779b97f4a7c15u >> 16) %
+           SAMPLE_LIVE;
+}
+
+/**
+ * @brief Returns the entry of sample_table holding `bp`, or the empty one
+ *        where it would go. Needs the heap lock.
+ */
+static size_t sample_find(const void *bp) {
+    size_t i = sample_slot(bp);
+    while (sample_table[i].bp != NULL && sample_table[i].bp != bp) {
+        i = (i + 1) % SAMPLE_LIVE;
+    }
+    return i;
+}
+
+/**
+ * @brief Finds or adds the site for a stack. Needs the heap lock.
+ * @return The site, or NULL if the table is full
+ */
+static sample_site_t *sample_site(void **stack, unsigned depth) {
+    for (size_t i = 0; i < sample_num_sites; i++) {
+        sample_site_t *site = &sample_sites[i];
+        if (site->depth == depth &&
+            memcmp(site->stack, stack, depth * sizeof(void *)) == 0) {
+            return site;
+        }
+    }
+    if (sample_num_sites == SAMPLE_SITES) {
+        return NULL;
+    }
+    sample_site_t *site = &sample_sites[sample_num_sites++];
+    memcpy(site->stack, stack, depth * sizeof(void *));
+    site->depth = depth;
+    return site;
+}
+
+/**
+ * @brief The slow path of sample_alloc: resets the countdown and, if
+ *        sampling is on, records the allocation at `bp`.
+ */
+static void sample_take(void *bp, size_t size) {
+    size_t rate = sample_rate;
+    if (rate == 0 || sample_busy) {
+        sample_left = SAMPLE_RECHECK;
+        return;
+    }
+    sample_left = sample_interval(rate);
+
+    // backtrace may allocate the first time it is called
+    void *stack[SAMPLE_DEPTH];
+    sample_busy = true;
+    int depth = backtrace(stack, SAMPLE_DEPTH);
+    sample_busy = false;
+    size_t usable = mm_usable_size(bp);
+    uint64_t start = sample_now_ns();
+
+    heap_lock();
+    sample_site_t *site = NULL;
+    if (sample_tables() && sample_live < SAMPLE_LIVE / 2) {
+        site = sample_site(stack, depth > 0 ? (unsigned)depth : 0);
+    }
+    if (site == NULL) {
+        sample_dropped++;
+    } else {
+        site->allocs++;
+        site->bytes += size;
+        site->usable_bytes += usable;
+        site->live++;
+        site->live_bytes += size;
+
+        size_t i = sample_find(bp);
+        if (sample_table[i].bp == NULL) {
+            __atomic_store_n(&sample_live, sample_live + 1, __ATOMIC_RELAXED);
+        }
+        sample_table[i] = (sample_live_t){bp, size, start, site};
+    }
+    heap_unlock();
+}
+
+/**
+ * @brief Counts an allocation of `size` bytes at `bp` towards the next
+ *        sample, and takes it when it is due.
+ */
+static void sample_alloc(void *bp, size_t size) {
+    if (size < sample_left) {
+        sample_left -= size;
+        return;
+    }
+    sample_take(bp, size);
+}
+
+/**
+ * @brief Removes entry `i` of sample_table, moving later entries of the
+ *        same probe sequence back so that no lookup stops short. Needs the
+ *        heap lock.
+ */
+static void sample_remove(size_t i) {
+    size_t j = i;
+    for (;;) {
+        sample_table[i].bp = NULL;
+        for (;;) {
+            j = (j + 1) % SAMPLE_LIVE;
+            if (sample_table[j].bp == NULL) {
+                return;
+            }
+            // Entry j may fill the hole at i if its home slot is not in
+            // the cyclic range (i, j]
+            size_t home = sample_slot(sample_table[j].bp);
+            if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+                break;
+            }
+        }
+        sample_table[i] = sample_table[j];
+        i = j;
+    }
+}
+
+/**
+ * @brief The slow path of sample_free: closes the sample at `bp`, if any.
+ */
+static void sample_forget(void *bp) {
+    uint64_t now = sample_now_ns();
+
+    heap_lock();
+    if (sample_table != NULL) {
+        size_t i = sample_find(bp);
+        if (sample_table[i].bp == bp) {
+            sample_live_t *entry = &sample_table[i];
+            entry->site->live--;
+            entry->site->live_bytes -= entry->size;
+            entry->site->frees++;
+            entry->site->lifetime_ns += now - entry->start_ns;
+            sample_remove(i);
+            __atomic_store_n(&sample_live, sample_live - 1, __ATOMIC_RELAXED);
+        }
+    }
+    heap_unlock();
+}
+
+/**
+ * @brief Closes the sample at `bp` if there may be one.
+ */
+static void sample_free(void *bp) {
+    if (__atomic_load_n(&sample_live, __ATOMIC_RELAXED) != 0) {
+        sample_forget(bp);
+    }
+}
+
+/**
+ * @brief Follows a sample through a realloc that kept the allocation
+ *        (resized in place, or moved by mremap): the sample at `old`, if
+ *        any, is moved to `bp` and its live bytes set to `size`, keeping its
+ *        site and start time.
+ */
+static void sample_realloc(void *old, void *bp, size_t size) {
+    if (__atomic_load_n(&sample_live, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    heap_lock();
+    if (sample_table != NULL) {
+        size_t i = sample_find(old);
+        if (sample_table[i].bp == old) {
+            sample_live_t entry = sample_table[i];
+            entry.site->live_bytes = entry.site->live_bytes - entry.size + size;
+            entry.bp = bp;
+            entry.size = size;
+            sample_remove(i);
+            sample_table[sample_find(bp)] = entry;
+        }
+    }
+    heap_unlock();
+}
+
+/**
+ * @brief Forgets every live sample, whose memory a new heap is about to
+ *        reuse; the sites keep what they have counted. Needs the heap lock.
+ */
+static void sample_reset_live(void) {
+    if (sample_table != NULL && sample_live != 0) {
+        memset(sample_table, 0, SAMPLE_LIVE * sizeof(sample_live_t));
+        for (size_t i = 0; i < sample_num_sites; i++) {
+            sample_sites[i].live = sample_sites[i].live_bytes = 0;
+        }
+        __atomic_store_n(&sample_live, 0, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Copies the sites into a fresh mapping, so that they can be printed
+ *        without the lock.
+ * @return The copy of `*length` bytes holding `*num_sites` sites, or NULL
+ *         if there are none or no memory
+ */
+static sample_site_t *sample_copy(size_t *num_sites, size_t *length) {
+    sample_site_t *copy = NULL;
+
+    heap_lock();
+    *num_sites = sample_num_sites;
+    *length = round_up(sample_num_sites * sizeof(sample_site_t) + 1,
+                       mem_pagesize());
+    if (sample_num_sites != 0) {
+        copy = mmap(NULL, *length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (copy == MAP_FAILED) {
+            copy = NULL;
+        } else {
+            memcpy(copy, sample_sites,
+                   sample_num_sites * sizeof(sample_site_t));
+        }
+    }
+    heap_unlock();
+    return copy;
+}
+
+/**
+ * @brief Writes the sampled profile to `out` in the legacy heap profile
+ *        format pprof reads ("heap_v2"), followed by the process's
+ *        mappings so that pprof can symbolize it.
+ *
+ * In-use figures are the samples not freed yet, allocated figures all
+ * samples taken; both are the raw samples, which pprof scales by the
+ * sampling rate given in the header.
+ *
+ * @param[in] out The stream to write to
+ * @return False if nothing was sampled or the copy could not be made
+ */
+bool mm_profile_pprof(FILE *out) {
+    size_t num_sites, length;
+    sample_site_t *sites = sample_copy(&num_sites, &length);
+    if (sites == NULL) {
+        return false;
+    }
+
+    size_t live = 0, live_bytes = 0, allocs = 0, bytes = 0;
+    for (size_t i = 0; i < num_sites; i++) {
+        live += sites[i].live;
+        live_bytes += sites[i].live_bytes;
+        allocs += sites[i].allocs;
+        bytes += sites[i].bytes;
+    }
+    fprintf(out, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n", live,
+            live_bytes, allocs, bytes, sample_rate);
+    for (size_t i = 0; i < num_sites; i++) {
+        fprintf(out, "%zu: %zu [%zu: %zu] @", sites[i].live,
+                sites[i].live_bytes, sites[i].allocs, sites[i].bytes);
+        for (unsigned j = 0; j < sites[i].depth; j++) {
+            fprintf(out, " %p", sites[i].stack[j]);
+        }
+        fprintf(out, "\n");
+    }
+    munmap(sites, length);
+
+    fprintf(out, "\nMAPPED_LIBRARIES:\n");
+    FILE *maps = fopen("/proc/self/maps", "r");
+    if (maps != NULL) {
+        char line[512];
+        while (fgets(line, sizeof(line), maps) != NULL) {
+            fputs(line, out);
+        }
+        fclose(maps);
+    }
+    return true;
+}
+
+/**
+ * @brief Writes the sampled profile to `out` as one JSON object: per site
+ *        its stack, the samples taken with their requested and usable
+ *        bytes, the samples still live, and the mean lifetime of those
+ *        freed.
+ * @param[in] out The stream to write to
+ */
+void mm_profile_print(FILE *out) {
+    size_t num_sites, length;
+    sample_site_t *sites = sample_copy(&num_sites, &length);
+
+    fprintf(out, "{\"sample_rate\":%zu,\"dropped\":%zu,\"sites\":[",
+            sample_rate, sample_dropped);
+    for (size_t i = 0; sites != NULL && i < num_sites; i++) {
+        const sample_site_t *site = &sites[i];
+        fprintf(out, "%s{\"stack\":[", i == 0 ? "" : ",");
+        for (unsigned j = 0; j < site->depth; j++) {
+            fprintf(out, "%s\"%p\"", j == 0 ? "" : ",", site->stack[j]);
+        }
+        fprintf(out,
+                "],\"allocs\":%zu,\"bytes\":%zu,\"usable_bytes\":%zu,"
+                "\"live\":%zu,\"live_bytes\":%zu,\"frees\":%zu,"
+                "\"mean_lifetime_ns\":%.0f}",
+                site->allocs, site->bytes, site->usable_bytes, site->live,
+                site->live_bytes, site->frees,
+                site->frees ? (double)site->lifetime_ns / site->frees : 0.0);
+    }
+    fprintf(out, "]}\n");
+    if (sites != NULL) {
+        munmap(sites, length);
+    }
+}
+
+/**
+ * @brief The body of malloc, which also tells calloc what to clear.
+ *
+ * Requests of at most slab_max bytes get a slab slot, and large requests
+ * their own mapping. In thread-safe mode small requests are served from
+ * the calling thread's cache; everything else takes the heap lock and goes
+ * through slab_alloc or alloc_block.
+ *
+ * @param[in] size The number of payload bytes requested
+ * @param[out] zeroed If not NULL, set to whether the payload already reads
+ *                    zero: a fresh mapping, or a heap block cleared by
+ *                    alloc_block
+ * @return A pointer to the payload, or NULL if `size` is 0 or the heap
+ *         could not be extended
+ */
+static void *alloc_payload(size_t size, bool *zeroed) {
+    block_t *block;
+    bool fresh = false;
+
+    if (zeroed != NULL) {
+        *zeroed = false;
+    }
+
+    // Ignore spurious request, and ones whose adjusted size would overflow
+    if (size == 0 || size > SIZE_MAX / 2) {
+        return NULL;
+    }
+
+    if (size <= slab_max) {
+        size_t cls = slab_class(size);
+        void *bp = tcache_slab_alloc(cls);
+        if (bp == NULL) {
+            heap_lock();
+            bp = slab_alloc(cls);
+            heap_unlock();
+        }
+        // A full slab region leaves small requests to the heap
+        if (bp != NULL) {
+            count_op(&thread_counts()->mallocs);
+            sample_alloc(bp, size);
+            latency_set_path(MM_PATH_SLAB);
+            return bp;
+        }
+    }
+
+    // Adjust block size to include overhead and to meet alignment requirements
+    size_t asize = adjust_size(size);
+
+    if (mmap_threshold != 0 && asize >= mmap_threshold) {
+        block = mmap_alloc(asize);
+        fresh = true;
+        latency_set_path(MM_PATH_MMAP);
+    } else {
+        block = tcache_alloc(asize);
+        if (block == NULL) {
+            heap_lock();
+            block = alloc_block(asize, zeroed == NULL ? NULL : &fresh);
+            heap_unlock();
+        } else {
+            latency_set_path(MM_PATH_CACHE);
+        }
+    }
+    if (block == NULL) {
+        latency_set_path(MM_PATH_OTHER); // failed, whatever was tried
+        return NULL;
+    }
+
+    count_op(&thread_counts()->mallocs);
+    if (zeroed != NULL) {
+        *zeroed = fresh;
+    }
+    sample_alloc(header_to_payload(block), size);
+    return header_to_payload(block);
+}
+
+/**
+ * @brief Allocates `size` bytes of 16-byte aligned memory.
+ * @param[in] size The number of payload bytes requested
+ * @return A pointer to the payload, or NULL if `size` is 0 or the heap
+ *         could not be extended
+ */
+void *malloc(size_t size) {
+    uint64_t start = latency_start();
+    void *bp = alloc_payload(size, NULL);
+    latency_end(MM_OP_MALLOC, start);
+    return bp;
+}
+
+/**
+ * @brief The body of free.
+ *
+ * Slab slots go back to their run and mmapped blocks are unmapped right
+ * away. In thread-safe mode small blocks and slots go to the calling
+ * thread's cache; everything else is coalesced back into the heap under
+ * the heap lock.
+ *
+ * @param[in] bp A payload returned by malloc, calloc or realloc
+ */
+static void free_payload(void *bp) {
+    sample_free(bp);
+
+    // Slots have no header, so this must come before looking for one
+    if (in_slab(bp)) {
+        harden_slot(bp);
+        count_op(&thread_counts()->frees);
+        latency_set_path(MM_PATH_SLAB);
+        if (!tcache_slab_free(bp)) {
+            heap_lock();
+            slab_free(bp);
+            heap_unlock();
+        }
+        return;
+    }
+
+    block_t *block = payload_to_header(bp);
+    harden_free(bp, in_heap(bp));
+
+    // The block should be marked as allocated
     dbg_assert(get_alloc(block));
-    // Mark the block as free
-   
-    
-    write_block(block, size, false, get_prev_alloc(block), get_mini_prev(block));
+    count_op(&thread_counts()->frees);
 
+    if (is_mmapped(block)) {
+        latency_set_path(MM_PATH_MMAP);
+        mmap_free(block);
+        return;
+    }
 
+    if (tcache_free(block, get_size(block))) {
+        latency_set_path(MM_PATH_CACHE);
+        return;
+    }
 
-    // Try to coalesce the block with its neighbors
-    coalesce_block(block);
+    heap_lock();
+    free_block(block, get_size(block));
+    heap_unlock();
+}
+
+/**
+ * @brief Frees the allocation at `bp` (see free_payload).
+ * @param[in] bp A payload returned by malloc, calloc or realloc, or NULL
+ */
+void free(void *bp) {
+    if (bp == NULL) {
+        return;
+    }
+    uint64_t start = latency_start();
+    free_payload(bp);
+    latency_end(MM_OP_FREE, start);
+}
+
+/**
+ * @brief Returns how many bytes of the allocation at `bp` can be used.
+ *
+ * At least what was requested: the slot size for a slab slot, and for a
+ * block everything but its header, including the rounding adjust_size adds
+ * and, for a mapping, most of the rest of its last page.
+ *
+ * @param[in] bp A payload returned by any of the allocation functions, or
+ *               NULL
+ * @return The usable size, or 0 for NULL
+ */
+size_t mm_usable_size(void *bp) {
+    if (bp == NULL) {
+        return 0;
+    }
+    if (in_slab(bp)) {
+        return slab_run_of(bp)->slot_size;
+    }
 
+    block_t *block = payload_to_header(bp);
+    dbg_assert(get_alloc(block));
+    return get_payload_size(block);
+}
 
-    dbg_ensures(mm_checkheap(__LINE__));
+/**
+ * @brief Allocates at least `size` bytes and reports how many were given.
+ *
+ * For growable buffers: every byte up to `*actual` may be used, so the
+ * buffer need not be resized until it outgrows that.
+ *
+ * @param[in] size The number of payload bytes requested
+ * @param[out] actual If not NULL, set to the usable size (0 on failure)
+ * @return A pointer to the payload, or NULL as for malloc
+ */
+void *mm_malloc_at_least(size_t size, size_t *actual) {
+    void *bp = malloc(size);
+    if (actual != NULL) {
+        *actual = mm_usable_size(bp);
+    }
+    return bp;
 }
 
 /**
- * @brief
+ * @brief Frees the allocation at `bp`, whose size the caller knows.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * The C23 free_sized, and what a C++ sized delete calls. A heap block is
+ * told from a slot or a mapping by its address alone, and its size follows
+ * from `size`, so a block bound for the calling thread's cache or a quick
+ * list is freed without reading its header. Debug builds check that `size`
+ * matches the block.
  *
- * @param[in] ptr
- * @param[in] size
- * @return
+ * @param[in] bp A payload returned by malloc, calloc or realloc, or NULL
+ * @param[in] size The size passed when it was allocated (or last resized)
+ */
+void free_sized(void *bp, size_t size) {
+    if (bp == NULL) {
+        return;
+    }
+
+    uint64_t start = latency_start();
+    if (!in_heap(bp)) {
+        dbg_assert(!in_slab(bp) || size <= slab_run_of(bp)->slot_size);
+        dbg_assert(in_slab(bp) ||
+                   get_payload_size(payload_to_header(bp)) >= size);
+        free_payload(bp);
+        latency_end(MM_OP_FREE, start);
+        return;
+    }
+
+    block_t *block = payload_to_header(bp);
+    size_t asize = adjust_size(size);
+    harden_free(bp, true);
+    if (hardened && get_size(block) != asize) {
+        harden_fail("free_sized with the wrong size", bp);
+    }
+
+    // Heap blocks are always split down to the adjusted size
+    dbg_assert(get_alloc(block) && !is_mmapped(block));
+    dbg_assert(get_size(block) == asize);
+    count_op(&thread_counts()->frees);
+    sample_free(bp);
+
+    if (tcache_free(block, asize)) {
+        latency_set_path(MM_PATH_CACHE);
+    } else {
+        heap_lock();
+        free_block(block, asize);
+        heap_unlock();
+    }
+    latency_end(MM_OP_FREE, start);
+}
+
+/**
+ * @brief Frees an allocation from memalign or aligned_alloc whose size the
+ *        caller knows (C23 free_aligned_sized, and the aligned sized delete).
+ * @param[in] bp A payload returned by memalign or aligned_alloc, or NULL
+ * @param[in] alignment The alignment it was allocated with
+ * @param[in] size The size it was allocated with
+ */
+void free_aligned_sized(void *bp, size_t alignment, size_t size) {
+    dbg_requires(bp == NULL || (uintptr_t)bp % alignment == 0);
+    free_sized(bp, size);
+}
+
+/**
+ * @brief Tries to resize an allocated block without moving it.
+ *
+ * Shrinking splits the tail off as a free block. Growing absorbs the next
+ * block when it is free, and when the block (or its free successor) is the
+ * last one in the heap, the heap is extended first so that the successor is
+ * large enough.
+ *
+ * @param[in] block An allocated block
+ * @param[in] asize The adjusted size the block should have
+ * @return True if the block now holds `asize` bytes, false if it must move
+ */
+static bool resize_in_place(block_t *block, size_t asize) {
+    dbg_requires(get_alloc(block));
+
+    size_t block_size = get_size(block);
+    if (asize <= block_size) {
+        split_block(block, asize, false);
+        return true;
+    }
+
+    block_t *next = find_next(block);
+    size_t avail = block_size;
+    if (!get_alloc(next)) {
+        avail += get_size(next);
+    }
+
+    if (avail < asize) {
+        // Only the tail of the heap can be grown past its neighbours
+        bool at_tail = get_size(next) == 0 ||
+                       (!get_alloc(next) && get_size(find_next(next)) == 0);
+        if (!at_tail) {
+            return false;
+        }
+        next = extend_heap(max(asize - avail, heap->chunksize));
+        if (next == NULL) {
+            return false;
+        }
+        dbg_assert(next == find_next(block));
+    }
+
+    // What is split off lies inside `next`, past its list links
+    bool zeroed = get_zeroed(next);
+    delete(next);
+    write_block(block, block_size + get_size(next), true,
+                get_prev_alloc(block), get_mini_prev(block));
+    split_block(block, asize, zeroed);
+    return true;
+}
+
+/**
+ * @brief Changes the size of the allocation at `ptr` to `size` bytes.
+ *
+ * The block is resized in place whenever the heap layout allows it, and
+ * mmapped blocks are resized with mremap; a slab slot stays put while the
+ * new size fits in it. Only when that fails is a new block allocated, the
+ * payload copied over and the old block freed. A sampled allocation that is
+ * not copied keeps its sample, under its new address and size.
+ *
+ * @param[in] ptr The payload to resize, or NULL to behave like malloc
+ * @param[in] size The new payload size, or 0 to behave like free
+ * @return The (possibly moved) payload, or NULL if allocation failed, in
+ *         which case the original block is left untouched
  */
 void *realloc(void *ptr, size_t size) {
     block_t *block = payload_to_header(ptr);
@@ -1277,42 +5377,82 @@ void *realloc(void *ptr, size_t size) {
         return malloc(size);
     }
 
-    // Otherwise, proceed with reallocation
-    newptr = malloc(size);
+    if (size > SIZE_MAX / 2) {
+        return NULL;
+    }
+
+    uint64_t start = latency_start();
+    count_op(&thread_counts()->reallocs);
+    if (in_slab(ptr)) {
+        if (size <= slab_run_of(ptr)->slot_size) {
+            sample_realloc(ptr, ptr, size);
+            latency_set_path(MM_PATH_IN_PLACE);
+            latency_end(MM_OP_REALLOC, start);
+            return ptr;
+        }
+    } else if (is_mmapped(block)) {
+        block_t *moved = mmap_resize(block, adjust_size(size));
+        if (moved != NULL) {
+            sample_realloc(ptr, header_to_payload(moved), size);
+            latency_set_path(MM_PATH_MMAP);
+            latency_end(MM_OP_REALLOC, start);
+            return header_to_payload(moved);
+        }
+    } else {
+        heap_lock();
+        bool resized = resize_in_place(block, adjust_size(size));
+        check_op(block, __LINE__);
+        heap_unlock();
+        if (resized) {
+            sample_realloc(ptr, ptr, size);
+            latency_set_path(MM_PATH_IN_PLACE);
+            latency_end(MM_OP_REALLOC, start);
+            return ptr;
+        }
+    }
+
+    // Otherwise, proceed with reallocation. The bodies of malloc and free
+    // are called directly, so that this call is timed once, as a realloc
+    newptr = alloc_payload(size, NULL);
 
     // If malloc fails, the original block is left untouched
     if (newptr == NULL) {
+        latency_end(MM_OP_REALLOC, start);
         return NULL;
     }
 
     // Copy the old data
-    copysize = get_payload_size(block); // gets size of old payload
+    copysize = in_slab(ptr) ? slab_run_of(ptr)->slot_size
+                            : get_payload_size(block); // gets size of old payload
     if (size < copysize) {
         copysize = size;
     }
     memcpy(newptr, ptr, copysize);
 
     // Free the old block
-    free(ptr);
+    free_payload(ptr);
 
+    latency_set_path(MM_PATH_MOVE);
+    latency_end(MM_OP_REALLOC, start);
     return newptr;
 }
 
 /**
- * @brief
+ * @brief Allocates zeroed memory for `elements` objects of `size` bytes.
  *
- * <What does this function do?>
- * <What are the function's arguments?>
- * <What is the function's return value?>
- * <Are there any preconditions or postconditions?>
+ * Memory that is known to read zero is not cleared again: fresh mappings,
+ * and heap blocks carved from zeroed free space (fresh heap extensions and
+ * released pages, see get_zeroed).
  *
  * @param[in] elements
  * @param[in] size
- * @return
+ * @return A pointer to the zeroed payload, or NULL if the product is 0,
+ *         overflows, or could not be allocated
  */
 void *calloc(size_t elements, size_t size) {
     void *bp;
     size_t asize = elements * size;
+    bool zeroed;
 
     if (elements == 0) {
         return NULL;
@@ -1322,17 +5462,374 @@ void *calloc(size_t elements, size_t size) {
         return NULL;
     }
 
-    bp = malloc(asize);
+    uint64_t start = latency_start();
+    bp = alloc_payload(asize, &zeroed);
     if (bp == NULL) {
+        latency_end(MM_OP_CALLOC, start);
         return NULL;
     }
+    count_op(&thread_counts()->callocs);
 
     // Initialize all bits to 0
-    memset(bp, 0, asize);
+    if (!zeroed) {
+        memset(bp, 0, asize);
+    }
 
+    latency_end(MM_OP_CALLOC, start);
     return bp;
 }
 
+/**
+ * @brief Allocates `size` bytes whose address is a multiple of `alignment`.
+ *
+ * Alignments up to 16 bytes are what malloc already guarantees. Larger
+ * ones are carved out of a free heap block, with the slack in front of the
+ * payload kept as a free block rather than wasted.
+ *
+ * @param[in] alignment A power of two
+ * @param[in] size The number of payload bytes requested
+ * @return The aligned payload, or NULL if `size` is 0, `alignment` is not a
+ *         power of two (errno is set to EINVAL) or memory ran out
+ */
+void *memalign(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (alignment <= dsize) {
+        return malloc(size);
+    }
+    if (size == 0 || size > SIZE_MAX / 4 || alignment > SIZE_MAX / 4) {
+        return NULL;
+    }
+
+    heap_lock();
+    block_t *block = alloc_aligned_block(alignment, adjust_size(size));
+    heap_unlock();
+    if (block == NULL) {
+        return NULL;
+    }
+
+    count_op(&thread_counts()->mallocs);
+    sample_alloc(header_to_payload(block), size);
+    return header_to_payload(block);
+}
+
+/**
+ * @brief C11 aligned_alloc: the same as memalign.
+ * @param[in] alignment A power of two
+ * @param[in] size The number of payload bytes requested
+ * @return The aligned payload, or NULL on failure
+ */
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+/**
+ * @brief POSIX posix_memalign: memalign that reports errors by value.
+ * @param[out] memptr Where to store the aligned payload
+ * @param[in] alignment A power of two multiple of sizeof(void *)
+ * @param[in] size The number of payload bytes requested
+ * @return 0 on success, EINVAL for a bad alignment, ENOMEM if memory ran out
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 ||
+        alignment % sizeof(void *) != 0) {
+        return EINVAL;
+    }
+    if (size == 0) {
+        *memptr = NULL;
+        return 0;
+    }
+
+    void *bp = memalign(alignment, size);
+    if (bp == NULL) {
+        return ENOMEM;
+    }
+    *memptr = bp;
+    return 0;
+}
+
+/**
+ * @brief Allocates `n` objects of `size` bytes each.
+ *
+ * Slab-sized objects are taken from their runs, and large ones get their
+ * own mappings, all under a single acquisition of the heap lock where one
+ * is needed. Heap-sized objects are carved back to back from one free
+ * block by alloc_batch_blocks. Each object can be freed on its own or with
+ * mm_free_batch.
+ *
+ * @param[in] size The number of payload bytes per object
+ * @param[in] n The number of objects
+ * @param[out] out Where to store the `n` payloads
+ * @return The number of objects allocated (stored at the start of `out`),
+ *         less than `n` only if memory ran out, and 0 if `size` is 0
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out) {
+    size_t done = 0;
+
+    if (size == 0 || size > SIZE_MAX / 2) {
+        return 0;
+    }
+
+    uint64_t start = latency_start();
+    if (size <= slab_max) {
+        size_t cls = slab_class(size);
+        void *bp;
+        heap_lock();
+        while (done < n && (bp = slab_alloc(cls)) != NULL) {
+            out[done++] = bp;
+        }
+        heap_unlock();
+        if (done != 0) {
+            latency_set_path(MM_PATH_SLAB);
+        }
+    }
+
+    // A full slab region leaves the rest to the heap
+    size_t asize = adjust_size(size);
+    if (done < n && mmap_threshold != 0 && asize >= mmap_threshold) {
+        block_t *block;
+        while (done < n && (block = mmap_alloc(asize)) != NULL) {
+            out[done++] = header_to_payload(block);
+            latency_set_path(MM_PATH_MMAP);
+        }
+    } else if (done < n) {
+        heap_lock();
+        size_t carved = alloc_batch_blocks(asize, n - done, out + done);
+        heap_unlock();
+        if (carved != 0) {
+            done += carved;
+            latency_set_path(MM_PATH_BATCH);
+        }
+    }
+
+    count_ops(&thread_counts()->mallocs, done);
+    for (size_t i = 0; i < done; i++) {
+        sample_alloc(out[i], size);
+    }
+    latency_end(MM_OP_MALLOC_BATCH, start);
+    return done;
+}
+
+/**
+ * @brief Orders two payload pointers by address, for qsort.
+ */
+static int compare_addresses(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(void *const *)a;
+    uintptr_t y = (uintptr_t)*(void *const *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Frees `n` allocations at once.
+ *
+ * The pointers are sorted by address so that neighbouring heap blocks are
+ * coalesced together, once per run (see free_batch_blocks), under a single
+ * acquisition of the heap lock. Mapped blocks are unmapped first, outside
+ * it. `ptrs` is used as scratch space: its contents are undefined after
+ * the call.
+ *
+ * @param[in] ptrs Payloads returned by any of the allocation functions, or
+ *                 NULL
+ * @param[in] n The number of pointers
+ */
+void mm_free_batch(void **ptrs, size_t n) {
+    uint64_t start = latency_start();
+    qsort(ptrs, n, sizeof(*ptrs), compare_addresses);
+
+    size_t kept = 0;
+    size_t freed = 0;
+    void *last = NULL;
+    for (size_t i = 0; i < n; i++) {
+        void *bp = ptrs[i];
+        if (bp == NULL) {
+            continue;
+        }
+        // Sorting brings a pointer passed twice next to itself
+        if (hardened && bp == last) {
+            harden_fail("double free", bp);
+        }
+        last = bp;
+        if (in_slab(bp)) {
+            harden_slot(bp);
+        } else {
+            harden_free(bp, in_heap(bp));
+        }
+        freed++;
+        sample_free(bp);
+        if (!in_slab(bp) && is_mmapped(payload_to_header(bp))) {
+            mmap_free(payload_to_header(bp));
+            latency_set_path(MM_PATH_MMAP);
+            continue;
+        }
+        ptrs[kept++] = bp;
+    }
+    count_ops(&thread_counts()->frees, freed);
+
+    if (kept != 0) {
+        heap_lock();
+        bool slot = in_slab(ptrs[kept - 1]);
+        free_batch_blocks(ptrs, kept);
+        heap_unlock();
+        latency_set_path(slot ? MM_PATH_SLAB : MM_PATH_BATCH);
+    }
+    latency_end(MM_OP_FREE_BATCH, start);
+}
+
+/*
+ * ---------------------------------------------------------------------------
+ *                        BUMP REGIONS
+ * ---------------------------------------------------------------------------
+ *
+ * A region hands out memory for objects that all die together by bumping a
+ * pointer through chunks of REGION_CHUNK bytes taken from the main heap
+ * with malloc: no fit search, no split, no header per object, and no
+ * coalescing, since objects are never freed one by one. mm_region_reset
+ * frees them all at once, keeping one chunk for the next round, and
+ * mm_region_release frees the chunks and the region itself. A request too
+ * large for a chunk gets a chunk of its own from malloc, released with the
+ * rest. A region takes no lock, so only one thread may use it at a time.
+ */
+
+/** @brief A chunk of a region, followed by the memory handed out from it */
+typedef struct region_chunk {
+    struct region_chunk *next;
+    /** @brief Pads the header to dsize, so objects stay 16-byte aligned */
+    size_t unused;
+} region_chunk_t;
+
+_Static_assert(sizeof(region_chunk_t) % 16 == 0,
+               "region objects must be 16-byte aligned");
+
+/** @brief A bump region */
+struct mm_region {
+    /** @brief Chunks bumped through, the current one first */
+    region_chunk_t *chunks;
+    /** @brief Chunks of single large objects */
+    region_chunk_t *large;
+    /** @brief The next free byte in the current chunk, and its end */
+    char *bump;
+    char *end;
+};
+
+/**
+ * @brief Creates an empty region; its first chunk is taken on first use.
+ * @return The region, or NULL if memory ran out
+ */
+mm_region_t *mm_region_create(void) {
+    mm_region_t *region = malloc(sizeof(*region));
+    if (region != NULL) {
+        memset(region, 0, sizeof(*region));
+    }
+    return region;
+}
+
+/**
+ * @brief Allocates from a fresh chunk, or a chunk of its own for a large
+ *        request; the slow path of mm_region_alloc.
+ * @param[in] region The region
+ * @param[in] asize The request, rounded up to dsize
+ * @return The memory, or NULL if malloc failed
+ */
+static void *region_refill(mm_region_t *region, size_t asize) {
+    region_chunk_t *chunk;
+
+    if (asize > REGION_CHUNK / 4) {
+        // The current chunk keeps its space for the requests after this one
+        chunk = malloc(sizeof(region_chunk_t) + asize);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = region->large;
+        region->large = chunk;
+        return chunk + 1;
+    }
+
+    // Asking for a whole block's worth leaves no slack at its end
+    chunk = malloc(REGION_CHUNK - wsize);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = region->chunks;
+    region->chunks = chunk;
+    region->bump = (char *)(chunk + 1) + asize;
+    region->end = (char *)chunk + mm_usable_size(chunk);
+    return chunk + 1;
+}
+
+/**
+ * @brief Allocates `size` bytes of 16-byte aligned memory from a region.
+ *
+ * The memory stays valid until the region is reset or released; it cannot
+ * be freed on its own.
+ *
+ * @param[in] region A region from mm_region_create
+ * @param[in] size The number of bytes requested
+ * @return The memory, or NULL if `size` is 0 or memory ran out
+ */
+void *mm_region_alloc(mm_region_t *region, size_t size) {
+    if (size == 0 || size > SIZE_MAX / 2) {
+        return NULL;
+    }
+
+    size_t asize = round_up(size, dsize);
+    if (asize <= (size_t)(region->end - region->bump)) {
+        void *bp = region->bump;
+        region->bump += asize;
+        return bp;
+    }
+    return region_refill(region, asize);
+}
+
+/**
+ * @brief Frees every chunk on a list but the first `keep`.
+ */
+static void region_free_chunks(region_chunk_t *chunk, size_t keep) {
+    while (chunk != NULL && keep > 0) {
+        region_chunk_t *next = chunk->next;
+        if (--keep == 0) {
+            chunk->next = NULL;
+        }
+        chunk = next;
+    }
+    while (chunk != NULL) {
+        region_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+/**
+ * @brief Frees everything allocated from a region, which stays usable.
+ *
+ * The current chunk is kept and bumped through again from the start, so a
+ * region reset after every request settles into no malloc calls at all.
+ *
+ * @param[in] region A region from mm_region_create
+ */
+void mm_region_reset(mm_region_t *region) {
+    region_free_chunks(region->large, 0);
+    region->large = NULL;
+    region_free_chunks(region->chunks, 1);
+    if (region->chunks != NULL) {
+        region->bump = (char *)(region->chunks + 1);
+    }
+}
+
+/**
+ * @brief Frees everything allocated from a region, and the region.
+ * @param[in] region A region from mm_region_create, or NULL
+ */
+void mm_region_release(mm_region_t *region) {
+    if (region == NULL) {
+        return;
+    }
+    region_free_chunks(region->large, 0);
+    region_free_chunks(region->chunks, 0);
+    free(region);
+}
+
 /*
  *****************************************************************************
  * Do not delete the following super-secret(tm) lines!                       *
@@ -0,0 +1,212 @@
+/**
+ * @file mm.h
+ * @brief Interface of the segregated free list allocator in mm.c
+ *
+ * With DRIVER defined the allocator is built under the mm_ names so that
+ * it can run next to the C library's malloc (the course driver and the
+ * programs in bench/ do this); otherwise it replaces malloc and friends.
+ */
+
+#ifndef MM_H
+#define MM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef DRIVER
+void *mm_malloc(size_t size);
+void mm_free(void *ptr);
+void *mm_realloc(void *ptr, size_t size);
+void *mm_calloc(size_t nmemb, size_t size);
+void *mm_memalign(size_t alignment, size_t size);
+void *mm_aligned_alloc(size_t alignment, size_t size);
+int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+void mm_free_sized(void *ptr, size_t size);
+void mm_free_aligned_sized(void *ptr, size_t alignment, size_t size);
+#else
+void *malloc(size_t size);
+void free(void *ptr);
+void *realloc(void *ptr, size_t size);
+void *calloc(size_t nmemb, size_t size);
+void *memalign(size_t alignment, size_t size);
+void *aligned_alloc(size_t alignment, size_t size);
+int posix_memalign(void **memptr, size_t alignment, size_t size);
+void free_sized(void *ptr, size_t size);
+void free_aligned_sized(void *ptr, size_t alignment, size_t size);
+#endif
+
+bool mm_init(void);
+bool mm_checkheap(int line);
+
+/** @brief Tunables for mm_mallopt() */
+enum mm_param {
+    /** Requests of at least this many bytes get their own mapping (0: never) */
+    MM_MMAP_THRESHOLD,
+    /** A free block this large at the end of the heap shrinks it (0: never) */
+    MM_TRIM_THRESHOLD,
+    /** Free bytes an automatic trim leaves at the end of the heap */
+    MM_TOP_PAD,
+    /** A free block this large elsewhere has its pages released (0: never) */
+    MM_RELEASE_THRESHOLD,
+    /** Smallest heap extension, and the first one after mm_init */
+    MM_CHUNKSIZE_MIN,
+    /** Largest heap extension (beyond what a single request needs) */
+    MM_CHUNKSIZE_MAX,
+    /** Requests of at most this many bytes come from slabs (0: never, at
+        most 256) */
+    MM_SLAB_MAX,
+    /** Freed blocks of at most this many bytes are coalesced later, in
+        batches (0: right away, at most 1024) */
+    MM_QUICK_MAX,
+    /** Bytes of freed blocks waiting to be coalesced that trigger a batch */
+    MM_QUICK_LIMIT,
+    /** One heap operation in this many checks the blocks it touches and
+        aborts if they are corrupt (0: never, 1 in debug builds) */
+    MM_CHECK_RATE,
+    /** One heap operation in this many runs all of mm_checkheap (0: never,
+        64 in debug builds) */
+    MM_CHECK_FULL,
+    /** One allocation in about this many bytes allocated has its stack
+        sampled for mm_profile_pprof (0: never) */
+    MM_SAMPLE_RATE,
+};
+
+bool mm_mallopt(int param, size_t value);
+size_t mm_trim(size_t pad);
+
+/** Bytes of an allocation that can be used, at least what was requested */
+size_t mm_usable_size(void *ptr);
+/** malloc that stores the usable size of the result in `*actual` */
+void *mm_malloc_at_least(size_t size, size_t *actual);
+
+/** Allocates `n` objects of `size` bytes into `out`; returns how many */
+size_t mm_malloc_batch(size_t size, size_t n, void **out);
+/** Frees `n` objects at once (NULLs are skipped); clobbers `ptrs` */
+void mm_free_batch(void **ptrs, size_t n);
+
+/** @brief A heap of its own, released all at once by mm_arena_destroy */
+typedef struct mm_arena mm_arena_t;
+
+mm_arena_t *mm_arena_create(void);
+void *mm_arena_malloc(mm_arena_t *arena, size_t size);
+void mm_arena_free(mm_arena_t *arena, void *ptr);
+void mm_arena_destroy(mm_arena_t *arena);
+
+/** @brief Bump allocation for objects freed all together */
+typedef struct mm_region mm_region_t;
+
+mm_region_t *mm_region_create(void);
+void *mm_region_alloc(mm_region_t *region, size_t size);
+void mm_region_reset(mm_region_t *region);
+void mm_region_release(mm_region_t *region);
+
+/** @brief Most size classes mm_stats can report */
+#define MM_MAX_CLASSES 64
+
+/** @brief Allocator counters, filled in by mm_stats() */
+typedef struct mm_stats {
+    /** Bytes obtained with mem_sbrk */
+    size_t heap_size;
+    /** Bytes of heap in allocated blocks, headers included */
+    size_t bytes_in_use;
+    /** Bytes of heap in free blocks */
+    size_t bytes_free;
+    /** Blocks with their own mapping, and the bytes mapped for them */
+    size_t mmap_count;
+    size_t mmap_bytes;
+    /** Slab runs carved and the bytes they span, and bytes in slab slots
+        in use */
+    size_t slab_runs;
+    size_t slab_size;
+    size_t slab_bytes;
+    /** Freed blocks waiting to be coalesced, and their bytes (counted in
+        bytes_in_use) */
+    size_t quick_blocks;
+    size_t quick_bytes;
+    /** Free blocks and free bytes per size class (num_classes entries) */
+    size_t num_classes;
+    size_t class_blocks[MM_MAX_CLASSES];
+    size_t class_bytes[MM_MAX_CLASSES];
+    /** Calls of each entry point */
+    size_t mallocs;
+    size_t frees;
+    size_t reallocs;
+    size_t callocs;
+    /** Heap extensions, block splits, and frees merged with a neighbour */
+    size_t extends;
+    size_t splits;
+    size_t coalesces;
+    /** Share of the heap not held by allocated blocks */
+    double fragmentation;
+} mm_stats_t;
+
+void mm_stats(mm_stats_t *stats);
+void mm_stats_print(FILE *out);
+
+/** Writes the block map and free lists as one line of JSON */
+bool mm_snapshot(FILE *out, const char *label);
+
+/** @brief Entry points timed by the latency histograms */
+enum mm_op {
+    MM_OP_MALLOC,
+    MM_OP_FREE,
+    MM_OP_REALLOC,
+    MM_OP_CALLOC,
+    MM_OP_MALLOC_BATCH,
+    MM_OP_FREE_BATCH,
+    MM_NUM_OPS,
+};
+
+/** @brief The way a call was served, as far as the histograms tell */
+enum mm_path {
+    /** Slab slot */
+    MM_PATH_SLAB,
+    /** Per-thread cache */
+    MM_PATH_CACHE,
+    /** Quick list of deferred blocks */
+    MM_PATH_QUICK,
+    /** Free block taken whole */
+    MM_PATH_FIT,
+    /** Free block split */
+    MM_PATH_SPLIT,
+    /** Heap extended first */
+    MM_PATH_EXTEND,
+    /** Block with its own mapping */
+    MM_PATH_MMAP,
+    /** Freed with both neighbours allocated, or merged with the one
+        before, the one after, or both */
+    MM_PATH_COALESCE_NONE,
+    MM_PATH_COALESCE_PREV,
+    MM_PATH_COALESCE_NEXT,
+    MM_PATH_COALESCE_BOTH,
+    /** Resized without moving */
+    MM_PATH_IN_PLACE,
+    /** Moved to a new allocation */
+    MM_PATH_MOVE,
+    /** Heap blocks of a batch, carved or coalesced together */
+    MM_PATH_BATCH,
+    /** None of the above, e.g. a failed call */
+    MM_PATH_OTHER,
+    MM_NUM_PATHS,
+};
+
+/** @brief Histogram buckets: bucket 0 counts calls under 1 ns, bucket b
+    those from 2^(b-1) up to 2^b ns, the last one everything longer */
+#define MM_LATENCY_BUCKETS 32
+
+/** @brief Latency histograms per entry point and path, filled in by
+    mm_latency() when built with MM_LATENCY */
+typedef struct mm_latency {
+    size_t count[MM_NUM_OPS][MM_NUM_PATHS][MM_LATENCY_BUCKETS];
+} mm_latency_t;
+
+bool mm_latency(mm_latency_t *latency);
+void mm_latency_print(FILE *out);
+
+/** Writes the sampled allocation profile as a pprof heap profile */
+bool mm_profile_pprof(FILE *out);
+/** Writes the sampled allocation profile, per call site, as JSON */
+void mm_profile_print(FILE *out);
+
+#endif /* MM_H */
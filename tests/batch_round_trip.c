@@ -0,0 +1,145 @@
+/**
+ * @file batch_round_trip.c
+ * @brief Checks that mm_malloc_batch and mm_free_batch give back what they
+ *        took
+ *
+ * Allocates batches of slab, heap and mapped sizes, plus a few objects
+ * with plain malloc, fills each object, and checks that none overlap and
+ * that the contents survive. Then frees some batch objects one by one and
+ * everything else with a single shuffled mm_free_batch (with NULLs mixed
+ * in), and checks that the heap holds no more than before and that no
+ * slab slot or mapping is left. Prints "ok" and exits 0, or names the
+ * first check that failed.
+ *
+ * Build and run:
+ *
+ *     cc -O2 -DDRIVER -I. -Ibench mm.c bench/memlib.c \
+ *        tests/batch_round_trip.c -o batch_round_trip
+ *     ./batch_round_trip
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/** @brief A batch: slab, heap and mapped sizes */
+typedef struct batch {
+    size_t size;
+    size_t n;
+} batch_t;
+
+static const batch_t batches[] = {{48, 500}, {3000, 500}, {200000, 8}};
+
+#define NUM_BATCHES (sizeof(batches) / sizeof(batches[0]))
+#define SINGLES 50
+#define MAX_OBJECTS 1100
+
+static void *objects[MAX_OBJECTS];
+static size_t sizes[MAX_OBJECTS];
+static size_t num_objects;
+
+static void fail(const char *what) {
+    printf("%s\n", what);
+    exit(1);
+}
+
+static int compare_addresses(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(void *const *)a;
+    uintptr_t y = (uintptr_t)*(void *const *)b;
+    return (x > y) - (x < y);
+}
+
+static void add(void *p, size_t size) {
+    if (p == NULL || (uintptr_t)p % 16 != 0 || mm_usable_size(p) < size) {
+        fail("an allocation is missing, misaligned or too small");
+    }
+    memset(p, (int)(num_objects & 0xFF), size);
+    objects[num_objects] = p;
+    sizes[num_objects++] = size;
+}
+
+static void check_objects(void) {
+    for (size_t i = 0; i < num_objects; i++) {
+        const unsigned char *p = objects[i];
+        for (size_t j = 0; j < sizes[i]; j += 61) {
+            if (p[j] != (i & 0xFF)) {
+                fail("an object was overwritten");
+            }
+        }
+    }
+    void *sorted[MAX_OBJECTS];
+    memcpy(sorted, objects, num_objects * sizeof(*objects));
+    qsort(sorted, num_objects, sizeof(*sorted), compare_addresses);
+    for (size_t i = 1; i < num_objects; i++) {
+        if ((char *)sorted[i] - (char *)sorted[i - 1] <
+            (ptrdiff_t)mm_usable_size(sorted[i - 1])) {
+            fail("two objects overlap");
+        }
+    }
+}
+
+int main(void) {
+    mem_init();
+    if (!mm_init()) {
+        fail("mm_init failed");
+    }
+    mm_stats_t before;
+    mm_stats(&before);
+
+    for (size_t b = 0; b < NUM_BATCHES; b++) {
+        void *out[500];
+        if (mm_malloc_batch(batches[b].size, batches[b].n, out) !=
+            batches[b].n) {
+            fail("mm_malloc_batch allocated too few objects");
+        }
+        for (size_t i = 0; i < batches[b].n; i++) {
+            add(out[i], batches[b].size);
+        }
+        for (size_t i = 0; i < SINGLES / NUM_BATCHES; i++) {
+            add(mm_malloc(batches[b].size), batches[b].size);
+        }
+    }
+    check_objects();
+
+    // Every seventh object is freed on its own, the rest in one batch
+    void *ptrs[MAX_OBJECTS + MAX_OBJECTS / 10];
+    size_t n = 0;
+    for (size_t i = 0; i < num_objects; i++) {
+        if (i % 7 == 0) {
+            mm_free(objects[i]);
+        } else {
+            ptrs[n++] = objects[i];
+        }
+        if (i % 10 == 0) {
+            ptrs[n++] = NULL;
+        }
+    }
+    srand(1);
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = (size_t)rand() % (i + 1);
+        void *tmp = ptrs[i];
+        ptrs[i] = ptrs[j];
+        ptrs[j] = tmp;
+    }
+    mm_free_batch(ptrs, n);
+
+    mm_stats_t after;
+    mm_stats(&after);
+    if (after.bytes_in_use != before.bytes_in_use || after.slab_bytes != 0 ||
+        after.mmap_count != 0) {
+        printf("left in use: %zu heap bytes (%zu before), %zu slab bytes, "
+               "%zu mappings\n",
+               after.bytes_in_use, before.bytes_in_use, after.slab_bytes,
+               after.mmap_count);
+        return 1;
+    }
+    if (!mm_checkheap(__LINE__)) {
+        fail("mm_checkheap failed");
+    }
+    printf("ok\n");
+    return 0;
+}
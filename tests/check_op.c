@@ -0,0 +1,139 @@
+/**
+ * @file check_op.c
+ * @brief Checks that MM_CHECK_RATE catches a corrupted header on the next
+ *        operation that touches it
+ *
+ * Each case runs in a child process with MM_CHECK_RATE 1: it allocates
+ * three neighbouring blocks, corrupts a header the way a stray write
+ * would, and frees the first block. The child must abort with the
+ * checker's report, and a child that corrupts nothing must exit cleanly.
+ * Built with -DMM_HARDEN, the free's own checks may report the corruption
+ * first, which is accepted as well.
+ * Prints "ok" and exits 0, or names the first case that went otherwise.
+ *
+ * Build and run:
+ *
+ *     cc -O2 -DDRIVER -I. -Ibench mm.c bench/memlib.c \
+ *        tests/check_op.c -o check_op
+ *     ./check_op
+ */
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/** @brief What a case does to the blocks before the first one is freed */
+typedef enum corruption {
+    CORRUPT_NONE,
+    /** Clears the bit in the second block's header that says the first
+        one is allocated */
+    CORRUPT_PREV_ALLOC,
+    /** Changes the size in the first block's header */
+    CORRUPT_SIZE,
+    /** Overruns the first block into the second one's header */
+    CORRUPT_OVERRUN,
+} corruption_t;
+
+/** @brief The report every case must print before aborting */
+#ifdef MM_HARDEN
+#define REPORT "mm: "
+#else
+#define REPORT "mm: heap check failed"
+#endif
+
+/** @brief Heap blocks, too big for a slab */
+#define SIZE 1000
+
+static void run_case(corruption_t corruption) {
+    mem_init();
+    if (!mm_init()) {
+        _exit(2);
+    }
+    mm_mallopt(MM_CHECK_RATE, 1);
+    char *a = mm_malloc(SIZE);
+    char *b = mm_malloc(SIZE);
+    char *c = mm_malloc(SIZE);
+    if (a == NULL || b == NULL || c == NULL) {
+        _exit(2);
+    }
+
+    uint64_t *a_header = (uint64_t *)a - 1;
+    uint64_t *b_header = (uint64_t *)b - 1;
+    switch (corruption) {
+    case CORRUPT_NONE:
+        break;
+    case CORRUPT_PREV_ALLOC:
+        *b_header &= ~(uint64_t)0x2;
+        break;
+    case CORRUPT_SIZE:
+        *a_header += 0x100;
+        break;
+    case CORRUPT_OVERRUN:
+        memset(a, 0x41, (size_t)(b - a));
+        break;
+    }
+    mm_free(a);
+    _exit(0);
+}
+
+/**
+ * @brief Runs a case in a child and returns whether it ended as expected.
+ */
+static bool check_case(const char *name, corruption_t corruption) {
+    int err[2];
+    if (pipe(err) != 0) {
+        perror("pipe");
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        dup2(err[1], STDERR_FILENO);
+        close(err[0]);
+        run_case(corruption);
+    }
+    close(err[1]);
+    char report[256] = {0};
+    size_t len = 0;
+    ssize_t got;
+    while (len < sizeof(report) - 1 &&
+           (got = read(err[0], report + len, sizeof(report) - 1 - len)) > 0) {
+        len += (size_t)got;
+    }
+    close(err[0]);
+    int status;
+    waitpid(pid, &status, 0);
+
+    bool ok;
+    if (corruption == CORRUPT_NONE) {
+        ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    } else {
+        ok = WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT &&
+             strstr(report, REPORT) != NULL;
+    }
+    if (!ok) {
+        printf("%s: status %d, stderr \"%s\"\n", name, status, report);
+    }
+    return ok;
+}
+
+int main(void) {
+    if (!check_case("no corruption", CORRUPT_NONE) ||
+        !check_case("prev_alloc bit cleared", CORRUPT_PREV_ALLOC) ||
+        !check_case("size changed", CORRUPT_SIZE) ||
+        !check_case("overrun", CORRUPT_OVERRUN)) {
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,223 @@
+/**
+ * @file json_keys.c
+ * @brief Checks the keys and values that mm_stats_print, mm_snapshot and
+ *        mm_latency_print write
+ *
+ * Runs a small workload that leaves heap, slab, mapped and quick blocks
+ * behind, captures each writer's output in memory, and checks that it is
+ * one line holding the documented keys in order, with values that match
+ * mm_stats and no internal names (such as "->") leaking into a key. The
+ * snapshot's blocks must add up to the heap, and its quick flags to the
+ * quick blocks. Prints "ok" and exits 0, or names the first check that
+ * failed.
+ *
+ * Build and run:
+ *
+ *     cc -O2 -DDRIVER -I. -Ibench mm.c bench/memlib.c \
+ *        tests/json_keys.c -o json_keys
+ *     ./json_keys
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+static const char *const stats_keys[] = {
+    "heap_size",    "bytes_in_use", "bytes_free",    "mmap_count",
+    "mmap_bytes",   "slab_runs",    "slab_size",     "slab_bytes",
+    "quick_blocks", "quick_bytes",  "mallocs",       "frees",
+    "reallocs",     "callocs",      "extends",       "splits",
+    "coalesces",    "fragmentation", "classes"};
+
+static const char *const snapshot_keys[] = {
+    "label", "ops", "heap_size", "chunksize", "blocks", "classes"};
+
+static const char *const latency_keys[] = {
+    "malloc", "free", "realloc", "calloc", "malloc_batch", "free_batch"};
+
+#define NUM_KEYS(keys) (sizeof(keys) / sizeof(keys[0]))
+
+/** @brief Flag of a block waiting on a quick list, as in mm_snapshot */
+#define SNAPSHOT_QUICK 16
+
+static void fail(const char *what, const char *json) {
+    printf("%s\n", what);
+    if (json != NULL) {
+        printf("in %s", json);
+    }
+    exit(1);
+}
+
+/** @brief Runs `write` on a memory stream and returns what it wrote */
+static char *capture(void (*write)(FILE *)) {
+    char *json;
+    size_t length;
+    FILE *out = open_memstream(&json, &length);
+    if (out == NULL) {
+        fail("open_memstream failed", NULL);
+    }
+    write(out);
+    fclose(out);
+    return json;
+}
+
+static void write_snapshot(FILE *out) {
+    if (!mm_snapshot(out, "json_keys")) {
+        fail("mm_snapshot failed", NULL);
+    }
+}
+
+/**
+ * @brief Checks that `json` is one object on one line, holding each of
+ *        `keys` in order, and no "->".
+ */
+static void check_keys(const char *json, const char *const *keys,
+                       size_t num_keys) {
+    size_t length = strlen(json);
+    if (length < 3 || json[0] != '{' || strcmp(json + length - 2, "}\n") != 0 ||
+        strchr(json, '\n') != json + length - 1) {
+        fail("not one JSON object on one line", json);
+    }
+    if (strstr(json, "->") != NULL) {
+        fail("a key holds \"->\"", json);
+    }
+    const char *from = json;
+    for (size_t i = 0; i < num_keys; i++) {
+        char quoted[64];
+        snprintf(quoted, sizeof(quoted), "\"%s\":", keys[i]);
+        const char *at = strstr(from, quoted);
+        if (at == NULL) {
+            char what[96];
+            snprintf(what, sizeof(what), "key \"%s\" missing or out of order",
+                     keys[i]);
+            fail(what, json);
+        }
+        from = at + strlen(quoted);
+    }
+}
+
+/** @brief The number after the first "key": in `json` */
+static double value(const char *json, const char *key) {
+    char quoted[64];
+    snprintf(quoted, sizeof(quoted), "\"%s\":", key);
+    const char *at = strstr(json, quoted);
+    if (at == NULL) {
+        fail("key missing", json);
+    }
+    return strtod(at + strlen(quoted), NULL);
+}
+
+static size_t count(const char *json, const char *needle) {
+    size_t n = 0;
+    for (const char *at = strstr(json, needle); at != NULL;
+         at = strstr(at + 1, needle)) {
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief Adds up the sizes of the snapshot's blocks and counts those with
+ *        the quick flag.
+ */
+static void sum_blocks(const char *json, size_t *bytes, size_t *quick) {
+    const char *at = strstr(json, "\"blocks\":[");
+    const char *end = strstr(json, "],\"classes\"");
+    if (at == NULL || end == NULL) {
+        fail("snapshot blocks missing", json);
+    }
+    *bytes = 0;
+    *quick = 0;
+    for (at = strchr(at + strlen("\"blocks\":["), '['); at != NULL && at < end;
+         at = strchr(at + 1, '[')) {
+        size_t offset, size;
+        unsigned flags;
+        if (sscanf(at, "[%zu,%zu,%u]", &offset, &size, &flags) != 3) {
+            fail("a snapshot block is not [offset,size,flags]", json);
+        }
+        *bytes += size;
+        *quick += (flags & SNAPSHOT_QUICK) != 0;
+    }
+}
+
+int main(void) {
+    mem_init();
+    if (!mm_init()) {
+        fail("mm_init failed", NULL);
+    }
+    mm_mallopt(MM_QUICK_MAX, 1024);
+
+    // Heap, slab and mapped blocks, and a few small frees left on quick lists
+    void *keep[64];
+    for (size_t i = 0; i < 64; i++) {
+        keep[i] = mm_malloc(i % 2 == 0 ? 32 : 700);
+    }
+    void *mapped = mm_malloc(1 << 20);
+    void *fenced[8];
+    for (size_t i = 0; i < 8; i++) {
+        fenced[i] = mm_malloc(600);
+        mm_malloc(600);
+    }
+    for (size_t i = 0; i < 8; i++) {
+        mm_free(fenced[i]);
+    }
+    keep[0] = mm_realloc(keep[0], 3000);
+    mm_free(mm_calloc(10, 100));
+    if (mapped == NULL || keep[0] == NULL) {
+        fail("malloc failed", NULL);
+    }
+
+    mm_stats_t stats;
+    mm_stats(&stats);
+    char *json = capture(mm_stats_print);
+    check_keys(json, stats_keys, NUM_KEYS(stats_keys));
+    if (value(json, "heap_size") != (double)stats.heap_size ||
+        value(json, "bytes_in_use") != (double)stats.bytes_in_use ||
+        value(json, "mmap_count") != (double)stats.mmap_count ||
+        value(json, "slab_bytes") != (double)stats.slab_bytes ||
+        value(json, "quick_blocks") != (double)stats.quick_blocks ||
+        value(json, "quick_bytes") != (double)stats.quick_bytes ||
+        value(json, "mallocs") != (double)stats.mallocs) {
+        fail("mm_stats_print does not match mm_stats", json);
+    }
+    if (stats.mmap_count == 0 || stats.slab_bytes == 0 ||
+        stats.quick_blocks == 0) {
+        fail("the workload left no mapped, slab or quick blocks", json);
+    }
+    if (count(json, "{\"blocks\":") != stats.num_classes) {
+        fail("mm_stats_print does not list every class", json);
+    }
+    free(json);
+
+    json = capture(write_snapshot);
+    check_keys(json, snapshot_keys, NUM_KEYS(snapshot_keys));
+    if (strstr(json, "\"label\":\"json_keys\"") == NULL ||
+        value(json, "heap_size") != (double)stats.heap_size ||
+        value(json, "ops") != (double)(stats.mallocs + stats.frees +
+                                       stats.reallocs + stats.callocs)) {
+        fail("mm_snapshot does not match mm_stats", json);
+    }
+    size_t bytes, quick;
+    sum_blocks(json, &bytes, &quick);
+    // The heap is the blocks plus the prologue and the epilogue
+    if (bytes + 16 != stats.heap_size) {
+        fail("the snapshot's blocks do not add up to the heap", json);
+    }
+    if (quick != stats.quick_blocks) {
+        fail("the snapshot's quick flags do not match quick_blocks", json);
+    }
+    free(json);
+
+    json = capture(mm_latency_print);
+    check_keys(json, latency_keys, NUM_KEYS(latency_keys));
+    free(json);
+
+    if (!mm_checkheap(__LINE__)) {
+        fail("mm_checkheap failed", NULL);
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file quick_trim.c
+ * @brief Checks that blocks on the quick lists are reused, merged when no
+ *        free block fits, and do not keep the heap from shrinking
+ *
+ * With deferred coalescing on, first checks that a freed block waits on a
+ * quick list without coalescing, that a request of its size takes it back,
+ * and that a request no free block fits merges every waiting block. Then
+ * allocates small blocks (quick list sizes)
+ * alternating with larger ones, frees the larger ones and then the small
+ * ones, each in a shuffled order, and checks that the heap was trimmed
+ * back down and that no block is left waiting on a quick list. Freed that
+ * way, every large block is fenced in by small ones until the end, and no
+ * single free coalesces into a block large enough to trim. Prints "ok" and
+ * exits 0, or what was left behind.
+ *
+ * Build and run:
+ *
+ *     cc -O2 -DDRIVER -I. -Ibench mm.c bench/memlib.c \
+ *        tests/quick_trim.c -o quick_trim
+ *     ./quick_trim
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+#define PAIRS 2000
+
+/** @brief Heap left after everything is freed: the top pad and a chunk */
+#define MAX_LEFT (1 << 20)
+
+static void *small[PAIRS];
+static void *large[PAIRS];
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15;
+
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static size_t quick_blocks(void) {
+    mm_stats_t stats;
+    mm_stats(&stats);
+    return stats.quick_blocks;
+}
+
+/** @brief Checks reuse of a quick block, and the merge on a miss */
+static bool check_merge(void) {
+    void *a = mm_malloc(500);
+    void *fence = mm_malloc(500);
+    void *b = mm_malloc(500);
+    void *fence2 = mm_malloc(500);
+    mm_stats_t stats;
+    mm_stats(&stats);
+    size_t coalesces = stats.coalesces;
+
+    mm_free(a);
+    mm_free(b);
+    mm_stats(&stats);
+    if (stats.quick_blocks != 2 || stats.coalesces != coalesces) {
+        printf("freed blocks did not wait on the quick lists\n");
+        return false;
+    }
+    if (mm_malloc(500) != b || quick_blocks() != 1) {
+        printf("a request did not take back the quick block\n");
+        return false;
+    }
+    void *big = mm_malloc(100000);
+    if (big == NULL || quick_blocks() != 0) {
+        printf("a request that nothing fit left %zu quick blocks\n",
+               quick_blocks());
+        return false;
+    }
+    mm_free(big);
+    mm_free(b);
+    mm_free(fence);
+    mm_free(fence2);
+    return true;
+}
+
+static void shuffle(void **ptrs, size_t n) {
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = rng() % (i + 1);
+        void *tmp = ptrs[i];
+        ptrs[i] = ptrs[j];
+        ptrs[j] = tmp;
+    }
+}
+
+int main(void) {
+    mem_init();
+    if (!mm_init()) {
+        printf("mm_init failed\n");
+        return 1;
+    }
+    mm_mallopt(MM_QUICK_MAX, 1024);
+    if (!check_merge()) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < PAIRS; i++) {
+        small[i] = mm_malloc(300 + rng() % 700);
+        large[i] = mm_malloc(2000 + rng() % 60000);
+        if (small[i] == NULL || large[i] == NULL) {
+            printf("malloc %zu failed\n", i);
+            return 1;
+        }
+    }
+    shuffle(large, PAIRS);
+    shuffle(small, PAIRS);
+    for (size_t i = 0; i < PAIRS; i++) {
+        mm_free(large[i]);
+    }
+    for (size_t i = 0; i < PAIRS; i++) {
+        mm_free(small[i]);
+    }
+
+    mm_stats_t stats;
+    mm_stats(&stats);
+    if (stats.heap_size > MAX_LEFT || stats.quick_blocks != 0) {
+        printf("heap_size=%zu quick_blocks=%zu quick_bytes=%zu after "
+               "freeing everything\n",
+               stats.heap_size, stats.quick_blocks, stats.quick_bytes);
+        return 1;
+    }
+    if (!mm_checkheap(__LINE__)) {
+        printf("mm_checkheap failed\n");
+        return 1;
+    }
+
+    printf("ok\n");
+    return 0;
+}
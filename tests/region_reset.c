@@ -0,0 +1,145 @@
+/**
+ * @file region_reset.c
+ * @brief Checks that mm_region_reset frees a region's objects and keeps
+ *        one chunk for the next round
+ *
+ * Fills rounds of small and large objects from a region, checking that
+ * they are aligned, do not overlap and keep their contents, and resets it
+ * after each round. A reset must leave only one chunk in use, the first
+ * requests after it must be served from that chunk without calling malloc,
+ * and the heap must stay within twice its size after the first round (it
+ * may grow a little as freed chunks fragment, but not with every round).
+ * Releasing the region must give back everything. Prints "ok" and exits 0,
+ * or names the first check that failed.
+ *
+ * Build and run:
+ *
+ *     cc -O2 -DDRIVER -I. -Ibench mm.c bench/memlib.c \
+ *        tests/region_reset.c -o region_reset
+ *     ./region_reset
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+#define ROUNDS 50
+#define OBJECTS 3000
+
+/** @brief A region chunk, as set in mm.c */
+#define CHUNK (1 << 16)
+
+/** @brief Every this many objects is too large to share a chunk */
+#define LARGE_EVERY 500
+#define LARGE_SIZE 20000
+
+static void *objects[OBJECTS];
+static size_t sizes[OBJECTS];
+
+static void fail(const char *what) {
+    printf("%s\n", what);
+    exit(1);
+}
+
+static int compare_objects(const void *a, const void *b) {
+    size_t i = *(const size_t *)a;
+    size_t j = *(const size_t *)b;
+    uintptr_t x = (uintptr_t)objects[i];
+    uintptr_t y = (uintptr_t)objects[j];
+    return (x > y) - (x < y);
+}
+
+static void fill_round(mm_region_t *region, unsigned seed) {
+    srand(seed);
+    for (size_t i = 0; i < OBJECTS; i++) {
+        sizes[i] = i % LARGE_EVERY == LARGE_EVERY - 1
+                       ? LARGE_SIZE
+                       : 1 + (size_t)rand() % 200;
+        objects[i] = mm_region_alloc(region, sizes[i]);
+        if (objects[i] == NULL || (uintptr_t)objects[i] % 16 != 0) {
+            fail("mm_region_alloc returned a bad object");
+        }
+        memset(objects[i], (int)((i + seed) & 0xFF), sizes[i]);
+    }
+}
+
+static void check_round(unsigned seed) {
+    size_t order[OBJECTS];
+    for (size_t i = 0; i < OBJECTS; i++) {
+        const unsigned char *p = objects[i];
+        for (size_t j = 0; j < sizes[i]; j++) {
+            if (p[j] != ((i + seed) & 0xFF)) {
+                fail("an object was overwritten");
+            }
+        }
+        order[i] = i;
+    }
+    qsort(order, OBJECTS, sizeof(*order), compare_objects);
+    for (size_t k = 1; k < OBJECTS; k++) {
+        size_t prev = order[k - 1];
+        if ((uintptr_t)objects[order[k]] - (uintptr_t)objects[prev] <
+            sizes[prev]) {
+            fail("two objects overlap");
+        }
+    }
+}
+
+static mm_stats_t stats(void) {
+    mm_stats_t s;
+    mm_stats(&s);
+    return s;
+}
+
+int main(void) {
+    mem_init();
+    if (!mm_init()) {
+        fail("mm_init failed");
+    }
+    size_t empty = stats().bytes_in_use;
+    mm_region_t *region = mm_region_create();
+    if (region == NULL) {
+        fail("mm_region_create failed");
+    }
+    size_t created = stats().bytes_in_use;
+
+    size_t heap_size = 0;
+    for (unsigned round = 0; round < ROUNDS; round++) {
+        fill_round(region, round);
+        check_round(round);
+        mm_region_reset(region);
+
+        mm_stats_t s = stats();
+        if (s.bytes_in_use > created + CHUNK) {
+            fail("a reset left more than one chunk in use");
+        }
+        if (round == 0) {
+            heap_size = s.heap_size;
+        } else if (s.heap_size > 2 * heap_size) {
+            fail("the heap keeps growing from round to round");
+        }
+
+        // The kept chunk serves the next requests without malloc
+        size_t mallocs = s.mallocs;
+        for (size_t i = 0; i < CHUNK / 2 / 64; i++) {
+            mm_region_alloc(region, 64);
+        }
+        if (stats().mallocs != mallocs) {
+            fail("requests after a reset did not fit the kept chunk");
+        }
+        mm_region_reset(region);
+    }
+
+    mm_region_release(region);
+    if (stats().bytes_in_use != empty) {
+        fail("mm_region_release did not give back everything");
+    }
+    if (!mm_checkheap(__LINE__)) {
+        fail("mm_checkheap failed");
+    }
+    printf("ok\n");
+    return 0;
+}
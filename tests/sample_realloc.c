@@ -0,0 +1,144 @@
+/**
+ * @file sample_realloc.c
+ * @brief Checks that allocation samples follow realloc
+ *
+ * Samples every allocation (MM_SAMPLE_RATE 1) and resizes it the ways
+ * realloc can without copying (a slab slot in place, a heap block in place,
+ * a mapping with mremap, which may move it) and by copying, then carries
+ * one allocation from a slot to the heap, to a mapping and back. After each
+ * step the live samples and bytes in mm_profile_print must be those of the
+ * allocations still held. Freeing through mm_free_batch and mm_free_sized
+ * must close their samples too, and none may be left once everything is
+ * freed.
+ * Prints "ok" and exits 0, or names the first step that failed.
+ *
+ * Build and run:
+ *
+ *     cc -O2 -DDRIVER -I. -Ibench mm.c bench/memlib.c \
+ *        tests/sample_realloc.c -o sample_realloc
+ *     ./sample_realloc
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/** @brief What the profile says is live, summed over its sites */
+typedef struct live {
+    size_t live;
+    size_t live_bytes;
+} live_t;
+
+static size_t sum_field(const char *json, const char *key) {
+    size_t total = 0;
+    size_t len = strlen(key);
+    for (const char *p = json; (p = strstr(p, key)) != NULL; p += len) {
+        total += strtoull(p + len, NULL, 10);
+    }
+    return total;
+}
+
+static live_t profile_live(void) {
+    char *json = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&json, &size);
+    if (out == NULL) {
+        perror("open_memstream");
+        exit(1);
+    }
+    mm_profile_print(out);
+    fclose(out);
+    live_t live = {sum_field(json, "\"live\":"),
+                   sum_field(json, "\"live_bytes\":")};
+    free(json);
+    return live;
+}
+
+static void expect(const char *step, size_t live, size_t live_bytes) {
+    live_t got = profile_live();
+    if (got.live != live || got.live_bytes != live_bytes) {
+        printf("%s: live=%zu live_bytes=%zu, expected live=%zu "
+               "live_bytes=%zu\n",
+               step, got.live, got.live_bytes, live, live_bytes);
+        exit(1);
+    }
+}
+
+static void *resize(void *ptr, size_t size) {
+    void *q = mm_realloc(ptr, size);
+    if (q == NULL) {
+        printf("realloc to %zu failed\n", size);
+        exit(1);
+    }
+    return q;
+}
+
+int main(void) {
+    mem_init();
+    if (!mm_init()) {
+        printf("mm_init failed\n");
+        return 1;
+    }
+    mm_mallopt(MM_SAMPLE_RATE, 1);
+
+    // A mapping, grown with mremap
+    void *map = mm_malloc(1 << 20);
+    expect("malloc mapping", 1, 1 << 20);
+    map = resize(map, 64 << 20);
+    expect("mremap", 1, 64 << 20);
+
+    // A slab slot, resized within its slot
+    void *slot = mm_malloc(20);
+    slot = resize(slot, 30);
+    expect("slot in place", 2, (64 << 20) + 30);
+
+    // The last heap block, grown in place
+    void *block = mm_malloc(1000);
+    block = resize(block, 3000);
+    expect("heap in place", 3, (64 << 20) + 30 + 3000);
+
+    // A heap block with a live neighbour, which must be copied
+    void *fenced = mm_malloc(1000);
+    void *fence = mm_malloc(1000);
+    fenced = resize(fenced, 8000);
+    expect("copied", 5, (64 << 20) + 30 + 3000 + 8000 + 1000);
+
+    size_t held = (64 << 20) + 30 + 3000 + 8000 + 1000;
+
+    // One sample carried through every kind of realloc and back
+    static const struct {
+        const char *step;
+        size_t size;
+    } moves[] = {{"slot to slot", 100},       {"slot to heap", 5000},
+                 {"heap to mapping", 300000}, {"mremap", 600000},
+                 {"mapping to heap", 2000},   {"heap to slot", 24}};
+    void *moving = mm_malloc(40);
+    expect("malloc moving", 6, held + 40);
+    for (size_t i = 0; i < sizeof(moves) / sizeof(moves[0]); i++) {
+        moving = resize(moving, moves[i].size);
+        expect(moves[i].step, 6, held + moves[i].size);
+    }
+
+    // Batch allocations are sampled, and batch and sized frees close them
+    void *batch[4];
+    if (mm_malloc_batch(700, 4, batch) != 4) {
+        printf("mm_malloc_batch failed\n");
+        return 1;
+    }
+    expect("malloc_batch", 10, held + 24 + 4 * 700);
+    void *ptrs[] = {map, batch[0], slot, NULL, batch[1], moving,
+                    batch[2], batch[3]};
+    mm_free_batch(ptrs, sizeof(ptrs) / sizeof(ptrs[0]));
+    expect("free_batch", 3, 3000 + 8000 + 1000);
+    mm_free_sized(block, 3000);
+    mm_free_sized(fenced, 8000);
+    expect("free_sized", 1, 1000);
+    mm_free(fence);
+    expect("all freed", 0, 0);
+
+    printf("ok\n");
+    return 0;
+}
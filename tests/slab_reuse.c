@@ -0,0 +1,149 @@
+/**
+ * @file slab_reuse.c
+ * @brief Checks that freed slab slots and emptied runs are used again
+ *
+ * Fills slab slots of one size with distinct bytes and checks that no two
+ * overlap, then frees every other one and checks that the same number of
+ * requests gets exactly those slots back without carving a run. Once
+ * everything is freed, the emptied runs must serve the same size again and
+ * a different slab size as well, still without carving any. Prints "ok"
+ * and exits 0, or names the first check that failed.
+ *
+ * Build and run:
+ *
+ *     cc -O2 -DDRIVER -I. -Ibench mm.c bench/memlib.c \
+ *        tests/slab_reuse.c -o slab_reuse
+ *     ./slab_reuse
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+#define SLOTS 1000
+#define SIZE 48
+#define OTHER_SIZE 200
+
+static void *slots[SLOTS];
+
+static void fail(const char *what) {
+    printf("%s\n", what);
+    exit(1);
+}
+
+static int compare_addresses(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(void *const *)a;
+    uintptr_t y = (uintptr_t)*(void *const *)b;
+    return (x > y) - (x < y);
+}
+
+static size_t slab_runs(void) {
+    mm_stats_t stats;
+    mm_stats(&stats);
+    return stats.slab_runs;
+}
+
+static size_t slab_bytes(void) {
+    mm_stats_t stats;
+    mm_stats(&stats);
+    return stats.slab_bytes;
+}
+
+/** @brief Allocates `n` slots of `size` bytes, each filled with its index */
+static void fill(size_t n, size_t size) {
+    for (size_t i = 0; i < n; i++) {
+        slots[i] = mm_malloc(size);
+        if (slots[i] == NULL || (uintptr_t)slots[i] % 16 != 0) {
+            fail("malloc returned a bad slot");
+        }
+        memset(slots[i], (int)(i & 0xFF), size);
+    }
+}
+
+/** @brief Checks the bytes written by fill, and that no two slots overlap */
+static void check_slots(size_t n, size_t size) {
+    for (size_t i = 0; i < n; i++) {
+        const unsigned char *p = slots[i];
+        for (size_t j = 0; j < size; j++) {
+            if (p[j] != (i & 0xFF)) {
+                fail("a slot was overwritten");
+            }
+        }
+    }
+    void *sorted[SLOTS];
+    memcpy(sorted, slots, n * sizeof(*slots));
+    qsort(sorted, n, sizeof(*sorted), compare_addresses);
+    for (size_t i = 1; i < n; i++) {
+        if ((char *)sorted[i] - (char *)sorted[i - 1] <
+            (ptrdiff_t)mm_usable_size(sorted[i - 1])) {
+            fail("two slots overlap");
+        }
+    }
+}
+
+int main(void) {
+    mem_init();
+    if (!mm_init()) {
+        fail("mm_init failed");
+    }
+
+    fill(SLOTS, SIZE);
+    check_slots(SLOTS, SIZE);
+    size_t runs = slab_runs();
+    size_t slot_size = mm_usable_size(slots[0]);
+    if (runs == 0 || slot_size < SIZE ||
+        slab_bytes() != SLOTS * slot_size) {
+        fail("slots were not served from slabs");
+    }
+
+    // Free every other slot; as many requests must get them all back
+    void *freed[SLOTS / 2];
+    for (size_t i = 0; i < SLOTS / 2; i++) {
+        freed[i] = slots[2 * i];
+        mm_free(slots[2 * i]);
+    }
+    qsort(freed, SLOTS / 2, sizeof(*freed), compare_addresses);
+    for (size_t i = 0; i < SLOTS / 2; i++) {
+        void *p = mm_malloc(SIZE);
+        if (bsearch(&p, freed, SLOTS / 2, sizeof(*freed),
+                    compare_addresses) == NULL) {
+            fail("a request did not reuse a freed slot");
+        }
+        slots[2 * i] = p;
+    }
+    if (slab_runs() != runs) {
+        fail("a run was carved while freed slots were left");
+    }
+
+    // Emptied runs serve the same size again, and any other slab size
+    for (size_t i = 0; i < SLOTS; i++) {
+        mm_free(slots[i]);
+    }
+    if (slab_bytes() != 0) {
+        fail("slab bytes left after freeing every slot");
+    }
+    fill(SLOTS, SIZE);
+    check_slots(SLOTS, SIZE);
+    for (size_t i = 0; i < SLOTS; i++) {
+        mm_free(slots[i]);
+    }
+    size_t other = runs * 4096 / OTHER_SIZE / 2;
+    fill(other, OTHER_SIZE);
+    check_slots(other, OTHER_SIZE);
+    if (slab_runs() != runs) {
+        fail("a run was carved while empty runs were left");
+    }
+    for (size_t i = 0; i < other; i++) {
+        mm_free(slots[i]);
+    }
+
+    if (!mm_checkheap(__LINE__)) {
+        fail("mm_checkheap failed");
+    }
+    printf("ok\n");
+    return 0;
+}
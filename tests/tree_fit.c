@@ -0,0 +1,84 @@
+/**
+ * @file tree_fit.c
+ * @brief Checks that large requests get the best fit from the free tree
+ *
+ * Frees large blocks of several sizes, each fenced in by an allocated
+ * block so that none coalesce, trims the free tail away, and checks that
+ * each request gets the smallest free block that fits, and the lowest of
+ * two equal ones. Prints "ok" and exits 0, or names the first request that
+ * got another block.
+ *
+ * Build and run:
+ *
+ *     cc -O2 -DDRIVER -I. -Ibench mm.c bench/memlib.c \
+ *        tests/tree_fit.c -o tree_fit
+ *     ./tree_fit
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/** @brief Payload sizes of the blocks freed into the tree, in heap order */
+static const size_t sizes[] = {20000, 40000, 30000, 30000, 24000, 60000};
+
+#define NUM_BLOCKS (sizeof(sizes) / sizeof(sizes[0]))
+
+/** @brief Keeps its neighbours from coalescing; too big for a slab */
+#define FENCE 512
+
+static void *blocks[NUM_BLOCKS];
+
+static void expect(const char *what, size_t size, size_t block) {
+    void *p = mm_malloc(size);
+    if (p != blocks[block]) {
+        printf("%s: malloc(%zu) returned %p, expected the %zu-byte block "
+               "at %p\n",
+               what, size, p, sizes[block], blocks[block]);
+        exit(1);
+    }
+}
+
+int main(void) {
+    mem_init();
+    if (!mm_init()) {
+        printf("mm_init failed\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < NUM_BLOCKS; i++) {
+        blocks[i] = mm_malloc(sizes[i]);
+        if (blocks[i] == NULL || mm_malloc(FENCE) == NULL) {
+            printf("malloc failed\n");
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < NUM_BLOCKS; i++) {
+        mm_free(blocks[i]);
+    }
+    // Without the free tail, the freed blocks are the only large ones
+    mm_trim(0);
+    mm_stats_t stats;
+    mm_stats(&stats);
+    if (stats.class_blocks[stats.num_classes - 1] != NUM_BLOCKS) {
+        printf("expected %zu free blocks in the tree, found %zu\n",
+               (size_t)NUM_BLOCKS, stats.class_blocks[stats.num_classes - 1]);
+        return 1;
+    }
+
+    expect("exact fit", 40000, 1);
+    expect("best fit", 22000, 4);
+    expect("lowest of two equal fits", 29000, 2);
+    expect("the other equal fit", 29000, 3);
+    expect("best fit below every other", 17000, 0);
+    expect("the only fit", 50000, 5);
+
+    if (!mm_checkheap(__LINE__)) {
+        printf("mm_checkheap failed\n");
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}